@@ -7,6 +7,7 @@ extern "C" {
 #include <pw.h>
 
 #define MW_MAX_RECURSION_DEPTH  100
+#define MW_MAX_INCLUDE_DEPTH    32
 
 #define MW_COMMENT  '#'
 
@@ -31,6 +32,142 @@ extern PwTypeId PwTypeId_MwStatus;
  */
 extern uint16_t MW_END_OF_BLOCK;  // for internal use
 extern uint16_t MW_PARSE_ERROR;
+extern uint16_t MW_UNSUPPORTED_TYPE;
+extern uint16_t MW_BAD_SNAPSHOT;
+extern uint16_t MW_LIMIT_EXCEEDED;
+
+typedef enum {
+    MW_PACKED_INT64,
+    MW_PACKED_FLOAT64
+} MwPackedType;
+
+typedef struct {
+    /*
+     * Packed numeric array.
+     */
+    MwPackedType item_type;
+    unsigned     length;
+    unsigned     capacity;
+    union {
+        void*    items;
+        int64_t* int64_items;
+        double*  float64_items;
+    };
+} MwPackedArrayData;
+
+#define _mw_packed_array_data_ptr(value)  ((MwPackedArrayData*) _pw_get_data_ptr((value), PwTypeId_MwPackedArray))
+
+extern PwTypeId PwTypeId_MwPackedArray;
+/*
+ * Type ID for packed numeric arrays.
+ */
+
+typedef struct _MwLineReader MwLineReader;
+
+struct _MwLineReader {
+    /*
+     * Line reader that replaces line reader interface of markup.
+     */
+    PwResult (*read_line)(MwLineReader* reader, PwValuePtr line);
+    /*
+     * Read next line into `line` in place, without line terminator.
+     * Return PW_ERROR_EOF when there are no more lines.
+     */
+    bool (*unread_line)(MwLineReader* reader, PwValuePtr line);
+    /*
+     * Push back the last line read. Only one line can be pushed back.
+     */
+    unsigned (*line_number)(MwLineReader* reader);
+    /*
+     * Return number of the last line read, starting from 1.
+     */
+    PwResult (*read_line_part)(MwLineReader* reader, PwValuePtr line, size_t max_length, bool* line_continues);
+    /*
+     * Optional. Same as read_line, but read at most `max_length` bytes of the line,
+     * not splitting UTF-8 sequences, and set `line_continues` if the line is longer.
+     * Then the next call reads the next part of the same line.
+     * Parts cannot be pushed back.
+     */
+};
+
+typedef struct _MwEventHandler MwEventHandler;
+
+struct _MwEventHandler {
+    /*
+     * Parsing events. If parser has event handler, lists and maps
+     * are not collected, their items are passed to the handler instead.
+     * Any error returned by handler stops parsing.
+     */
+    PwResult (*start_list)(MwEventHandler* handler);
+    PwResult (*end_list)(MwEventHandler* handler);
+    PwResult (*start_map)(MwEventHandler* handler);
+    PwResult (*end_map)(MwEventHandler* handler);
+    PwResult (*key)(MwEventHandler* handler, PwValuePtr key);
+    PwResult (*value)(MwEventHandler* handler, PwValuePtr value);
+    /*
+     * Called for values other than MYAW lists and maps,
+     * including values returned by custom parsers, e.g. :json:.
+     */
+};
+
+typedef struct {
+    /*
+     * Resource limits for parsing untrusted input. Zero means no limit.
+     */
+    size_t   max_input_size;     // characters read, including line breaks
+    size_t   max_nodes;          // list items, map entries, JSON array items and object members
+    size_t   max_string_length;  // length of line and total length of multi-line string or block
+    size_t   max_alloc_size;     // estimated size of values in bytes
+    unsigned timeout_ms;         // wall clock time
+} MwLimits;
+
+#define MW_MAX_STATS_CONVSPECS  16
+
+typedef enum {
+    MW_STATS_NULL,
+    MW_STATS_BOOL,
+    MW_STATS_SIGNED,
+    MW_STATS_UNSIGNED,
+    MW_STATS_FLOAT,
+    MW_STATS_STRING,
+    MW_STATS_LIST,      // including JSON arrays
+    MW_STATS_MAP,       // including JSON objects
+    MW_STATS_OTHER,     // date/time, packed arrays, etc.
+    MW_STATS_NUM_TYPES
+} MwStatsValueType;
+
+typedef struct {
+    void*    parser_func;  // MwBlockParserFunc, see mw_convspec_name
+    uint64_t calls;
+    uint64_t time_ns;      // including nested values
+} MwConvspecStats;
+
+typedef struct {
+    /*
+     * Parser statistics, collected when `stats_enabled` is set.
+     */
+    uint64_t lines_read;
+    uint64_t lines_unread;
+    uint64_t chars_read;
+    uint64_t values[MW_STATS_NUM_TYPES];
+    uint64_t allocations;     // values that allocate memory: strings, containers, etc.
+    uint64_t alloc_size;      // estimated, same as for limits
+    unsigned max_blocklevel;
+    unsigned max_json_depth;
+    unsigned num_convspecs;
+    MwConvspecStats convspecs[MW_MAX_STATS_CONVSPECS];  // all but the first MW_MAX_STATS_CONVSPECS are ignored
+} MwParserStats;
+
+typedef struct _MwIncludeFrame MwIncludeFrame;
+
+struct _MwIncludeFrame {
+    /*
+     * File being included, for detection of include cycles.
+     */
+    char*           path;    // canonical path
+    unsigned        depth;
+    MwIncludeFrame* parent;
+};
 
 typedef struct  {
     _PwValue  markup;
@@ -44,7 +181,27 @@ typedef struct  {
     unsigned  max_json_depth;
     bool      skip_comments;   // initially true to skip leading comments in the block
     bool      eof;
+    bool      validate_only;   // check syntax only, do not materialize values
     _PwValue  custom_parsers;
+    _PwValue  convspecs_with_arg;  // names of conversion specifiers that take an argument
+    MwLineReader* line_reader;  // optional, used instead of markup
+    bool      read_line_parts; // read long lines in parts, set by mw_parser_parse_json
+    bool      line_continues;  // current line is a part of longer line
+    MwEventHandler* event_handler;  // optional
+    bool      value_emitted;   // last parsed value was passed to event handler
+    bool      pack_json_arrays;  // store numeric JSON arrays packed
+    char*     include_dir;     // sandbox for :include:, set by mw_enable_include
+    _PwValue  include_cache;   // included files: canonical path -> [content hash, value]
+    MwIncludeFrame* include_frame;  // set for parsers of included files
+    _PwValue  convspec_arg;    // argument of last conversion specifier, e.g. name in :anchor name:
+    _PwValue  anchors;         // values saved by :anchor:, reset for each document
+    MwLimits  limits;
+    uint64_t  deadline;        // CLOCK_MONOTONIC time in nanoseconds, zero if no timeout
+    size_t    input_size;      // counters checked against limits
+    size_t    num_nodes;
+    size_t    alloc_size;
+    bool      stats_enabled;
+    MwParserStats stats;
 } MwParser;
 
 
@@ -55,6 +212,8 @@ MwParser* mw_create_parser(PwValuePtr markup);
  *
  * This function invokes pw_start_read_lines for markup.
  *
+ * If `markup` is null, `line_reader` must be set before parsing.
+ *
  * Return parser on success or nullptr if out of memory.
  */
 
@@ -63,6 +222,51 @@ void mw_delete_parser(MwParser** parser_ptr);
  * Delete parser. The format of the argument is natural for gnu::cleanup attribute.
  */
 
+PwResult mw_reset_parser(MwParser* parser, PwValuePtr markup);
+/*
+ * Prepare parser for parsing another `markup`, keeping line buffer,
+ * custom parsers, and cache of included files.
+ */
+
+PwResult mw_enable_include(MwParser* parser, char* include_dir);
+/*
+ * Enable :include: conversion specifier, which is disabled by default.
+ *
+ * Included files must be regular files inside `include_dir`.
+ * Absolute paths and paths that resolve outside of `include_dir` are rejected,
+ * files are opened without leaving `include_dir` even if it is modified concurrently.
+ * Error messages contain include paths as written in the markup.
+ * The string is not copied and must outlive the parser.
+ */
+
+void mw_set_limits(MwParser* parser, MwLimits* limits);
+/*
+ * Set resource limits. Timeout starts from this call and from each mw_reset_parser.
+ *
+ * Parsing stops with MW_LIMIT_EXCEEDED status when any limit is exceeded.
+ * Limits are checked when lines are read and when list items, map entries,
+ * and JSON array items and object members are parsed.
+ */
+
+MwParserStats* mw_parser_stats(MwParser* parser);
+/*
+ * Return statistics of the last document. Statistics are collected
+ * only if `stats_enabled` is set, and are reset by mw_reset_parser.
+ */
+
+void mw_reset_parser_stats(MwParser* parser);
+/*
+ * Clear statistics. mw_reset_parser calls it before parsing next document.
+ * Value counts are not collected in validation mode, where values
+ * are not materialized.
+ */
+
+PwResult mw_convspec_name(MwParser* parser, void* parser_func);
+/*
+ * Return conversion specifier of `parser_func` from MwConvspecStats,
+ * or null if not found.
+ */
+
 typedef PwResult (*MwBlockParserFunc)(MwParser* parser);
 
 PwResult mw_set_custom_parser(MwParser* parser, char* convspec, MwBlockParserFunc parser_func);
@@ -70,6 +274,94 @@ PwResult mw_set_custom_parser(MwParser* parser, char* convspec, MwBlockParserFun
  * Set custom parser function for `convspec`.
  */
 
+PwResult mw_set_custom_parser_with_arg(MwParser* parser, char* convspec, MwBlockParserFunc parser_func);
+/*
+ * Set custom parser function for `convspec` that takes an argument
+ * separated by space, e.g. :anchor name:
+ * The argument is available to parser function in `convspec_arg`.
+ *
+ * An argument given to other conversion specifiers is a parse error.
+ */
+
+/*
+ * Block reader for custom parsers
+ */
+
+typedef struct {
+    PwValuePtr line;         // parser's current line, valid until next call to mw_block_reader_next
+    unsigned   start;        // position of block indent, or end of line for short lines
+    unsigned   end;          // end of line
+    unsigned   line_number;
+} MwBlockLine;
+
+typedef struct {
+    MwParser* parser;
+    bool      started;
+    size_t    length;  // total length of lines read, for limits
+} MwBlockReader;
+
+void mw_block_reader_init(MwBlockReader* reader, MwParser* parser);
+/*
+ * Initialize reader for the current block. The first line returned
+ * is the parser's current line, as for custom parser functions.
+ */
+
+PwResult mw_block_reader_next(MwBlockReader* reader, MwBlockLine* line);
+/*
+ * Get next line of the block without copying it.
+ * Trailing spaces are already stripped.
+ *
+ * Return success, MW_END_OF_BLOCK if there are no more lines, or any other error.
+ */
+
+/*
+ * Packed numeric arrays
+ *
+ * Values produced by :int64[]: and :float64[]: conversion specifiers
+ * and by JSON parser for numeric arrays when `pack_json_arrays` is set.
+ */
+
+PwResult mw_create_packed_array(MwPackedType item_type, unsigned capacity);
+/*
+ * Create empty packed array with preallocated `capacity`.
+ */
+
+bool mw_is_packed_array(PwValuePtr value);
+
+MwPackedType mw_packed_type(PwValuePtr array);
+
+unsigned mw_packed_length(PwValuePtr array);
+
+int64_t* mw_packed_int64_items(PwValuePtr array);
+double* mw_packed_float64_items(PwValuePtr array);
+/*
+ * Return pointer to items, or nullptr if item type does not match.
+ * The pointer is valid until the array is modified.
+ */
+
+bool mw_packed_append_int64(PwValuePtr array, int64_t item);
+bool mw_packed_append_float64(PwValuePtr array, double item);
+/*
+ * Return false if out of memory or item type does not match.
+ */
+
+PwResult mw_packed_append(PwValuePtr array, PwValuePtr number);
+/*
+ * Append numeric value, converting integers to float for float64 arrays.
+ * Return MW_UNSUPPORTED_TYPE if value is not a number
+ * or does not fit int64 array.
+ */
+
+PwResult mw_packed_item(PwValuePtr array, unsigned index);
+/*
+ * Return item as Signed or Float value.
+ */
+
+PwResult mw_packed_to_array(PwValuePtr array);
+/*
+ * Return Array of boxed items.
+ */
+
 PwResult mw_parse(PwValuePtr markup);
 /*
  * Parse `markup`.
@@ -77,6 +369,79 @@ PwResult mw_parse(PwValuePtr markup);
  * Return parsed value or error.
  */
 
+PwResult mw_parser_parse(MwParser* parser);
+/*
+ * Parse markup the parser was created or reset for.
+ * This is what mw_parse does with a temporary parser.
+ */
+
+PwResult mw_parse_batch(PwValuePtr inputs, unsigned n, PwValuePtr results, unsigned nthreads);
+/*
+ * Parse `n` markups from `inputs` in parallel and write results
+ * to the corresponding elements of `results`, which must be initialized,
+ * e.g. with PwNull().
+ *
+ * Use `nthreads` threads including calling one. If zero, use number of online CPUs.
+ * Inputs are distributed between threads and idle threads steal work from busy ones.
+ *
+ * If some threads cannot be started, their inputs are processed by running ones.
+ * Parsing errors are written to `results`.
+ */
+
+PwResult mw_load_files(char** paths, unsigned n, PwValuePtr results);
+/*
+ * Read and parse `n` files from `paths` and write results to the corresponding
+ * elements of `results`, which must be initialized, e.g. with PwNull().
+ *
+ * If built with io_uring, opens and reads of many files are in flight
+ * at once and each file is parsed as soon as it is read, while the rest
+ * are still loading. Otherwise, or if io_uring is not available at run time,
+ * files are read one by one with plain syscalls.
+ *
+ * Errors of individual files are written to `results`.
+ * Return error only if out of memory.
+ */
+
+/*
+ * Read-ahead
+ */
+
+#define MW_READAHEAD_CHUNK_SIZE   (1024 * 1024)
+#define MW_READAHEAD_QUEUE_DEPTH  4
+
+PwResult mw_open_readahead(char* path, size_t chunk_size, unsigned queue_depth, MwLineReader** result);
+/*
+ * Open file at `path` and start background thread that reads it ahead
+ * into a ring of `queue_depth` chunks of `chunk_size` bytes, so parsing
+ * the current chunk overlaps with reading the next ones.
+ *
+ * Chunk size is rounded up to page size. Zero values select
+ * MW_READAHEAD_CHUNK_SIZE and MW_READAHEAD_QUEUE_DEPTH.
+ *
+ * The file must be UTF-8 encoded.
+ */
+
+void mw_close_readahead(MwLineReader** reader_ptr);
+/*
+ * Stop background thread and close file.
+ * The format of the argument is natural for gnu::cleanup attribute.
+ */
+
+PwResult mw_parse_file_readahead(char* path, size_t chunk_size, unsigned queue_depth);
+/*
+ * Parse file at `path` using read-ahead line reader.
+ */
+
+PwResult mw_validate(PwValuePtr markup);
+/*
+ * Check syntax of `markup` without building the result.
+ *
+ * Custom parsers are called as usual, built-in conversions
+ * do not allocate values.
+ *
+ * Return success or the first error.
+ */
+
 PwResult mw_parse_json(PwValuePtr markup);
 /*
  * Parse `markup` as pure JSON.
@@ -84,11 +449,531 @@ PwResult mw_parse_json(PwValuePtr markup);
  * Return parsed value or error.
  */
 
+#define MW_JSON_WINDOW_SIZE  (64 * 1024)
+
+PwResult mw_parser_parse_json(MwParser* parser);
+/*
+ * Same as mw_parse_json but use existing `parser`.
+ *
+ * If the parser has `line_reader` that supports reading lines in parts,
+ * e.g. read-ahead reader, long lines are read in parts of MW_JSON_WINDOW_SIZE bytes
+ * and parsed in a sliding window, which grows only to fit the longest string or number.
+ * So peak memory for minified JSON, which is a single line, does not depend
+ * on its length. Positions in error messages are relative to the window then.
+ */
+
+/*
+ * Direct binding to C structures
+ */
+
+#define MW_MAX_SCHEMA_FIELDS  64
+
+typedef enum {
+    MW_FIELD_BOOL,      // bool
+    MW_FIELD_SIGNED,    // int64_t
+    MW_FIELD_UNSIGNED,  // uint64_t
+    MW_FIELD_FLOAT,     // double
+    MW_FIELD_VALUE,     // _PwValue, any value, e.g. string; must be initialized, e.g. with PwNull()
+    MW_FIELD_STRUCT     // nested structure described by `schema`
+} MwFieldType;
+
+typedef struct _MwSchema MwSchema;
+
+typedef struct {
+    char*       name;
+    size_t      offset;    // offset of field in the structure, use offsetof
+    MwFieldType type;
+    MwSchema*   schema;    // schema of nested structure for MW_FIELD_STRUCT
+    bool        required;
+} MwSchemaField;
+
+struct _MwSchema {
+    MwSchemaField* fields;
+    unsigned       num_fields;  // up to MW_MAX_SCHEMA_FIELDS
+    bool           skip_unknown_keys;
+    int (*find_field)(PwValuePtr key);
+    /*
+     * Optional function that returns index of field for `key` or -1 if not found.
+     * Generated by myaw_codegen, linear search is used if not set.
+     */
+};
+
+PwResult mw_parse_into(PwValuePtr markup, MwSchema* schema, void* out);
+/*
+ * Parse `markup` which must be a map and write values directly
+ * to the structure `out` described by `schema`.
+ *
+ * Map values are not collected, only keys are allocated temporarily.
+ *
+ * Unknown keys are parse errors unless schema has `skip_unknown_keys` set.
+ * Missing required keys are parse errors too.
+ *
+ * Return success or error. On error `out` may be partially filled.
+ */
+
+PwResult mw_parser_parse_into(MwParser* parser, MwSchema* schema, void* out);
+/*
+ * Same as mw_parse_into but use existing `parser`, e.g. with limits set.
+ */
+
+/*
+ * Compiled snapshots
+ */
+
+typedef enum {
+    MW_NODE_NULL = 0,
+    MW_NODE_BOOL,
+    MW_NODE_SIGNED,
+    MW_NODE_UNSIGNED,
+    MW_NODE_FLOAT,
+    MW_NODE_STRING,
+    MW_NODE_ARRAY,
+    MW_NODE_MAP,
+    MW_NODE_INT64_ARRAY,
+    MW_NODE_FLOAT64_ARRAY
+} MwNodeType;
+
+typedef struct _MwSnapshot MwSnapshot;
+
+typedef struct {
+    /*
+     * Reference to a value in the snapshot.
+     * Nodes are valid until snapshot is unloaded.
+     */
+    MwSnapshot* snapshot;
+    uint32_t    offset;
+} MwNode;
+
+PwResult mw_compile(PwValuePtr markup, char* out_path);
+/*
+ * Parse `markup` and write binary snapshot of the result to `out_path`.
+ *
+ * Snapshot is written to a temporary file which is then renamed to `out_path`.
+ *
+ * Packed arrays are stored as vectors of 64-bit items and converted back
+ * to packed arrays by mw_node_to_value.
+ *
+ * Date/time and timestamp values are not supported, MW_UNSUPPORTED_TYPE
+ * is returned for them.
+ */
+
+PwResult mw_compile_value(PwValuePtr value, char* out_path);
+/*
+ * Write binary snapshot of `value` to `out_path`.
+ */
+
+PwResult mw_load_snapshot(char* path, MwSnapshot** result);
+/*
+ * Map snapshot into memory and write it to `result`.
+ *
+ * Return MW_BAD_SNAPSHOT if file is not a valid snapshot
+ * or was written by incompatible version.
+ */
+
+void mw_unload_snapshot(MwSnapshot** snapshot_ptr);
+/*
+ * Unmap snapshot. The format of the argument is natural for gnu::cleanup attribute.
+ */
+
+MwNode     mw_snapshot_root(MwSnapshot* snapshot);
+MwNodeType mw_node_type(MwNode node);
+bool       mw_node_bool(MwNode node);
+int64_t    mw_node_signed(MwNode node);
+uint64_t   mw_node_unsigned(MwNode node);
+double     mw_node_float(MwNode node);
+/*
+ * Node accessors. Out of range nodes are nulls.
+ *
+ * Scalar accessors check node type and return false or zero if it does not match,
+ * use mw_node_type to tell such nodes from zero values.
+ */
+
+char* mw_node_string(MwNode node, unsigned* length);
+/*
+ * Return pointer to zero-terminated UTF-8 string in the snapshot
+ * and write its length in bytes to `length`, if provided.
+ *
+ * Return nullptr if node is not a string.
+ */
+
+unsigned mw_node_length(MwNode node);
+/*
+ * Return number of items in array, map, or packed array node, zero for other nodes.
+ */
+
+int64_t* mw_node_int64_items(MwNode node);
+double*  mw_node_float64_items(MwNode node);
+/*
+ * Return pointer to items of packed array node in the snapshot,
+ * or nullptr if node type does not match.
+ * Items of packed arrays are not nodes, mw_node_item returns nulls for them.
+ */
+
+MwNode mw_node_item(MwNode array, unsigned index);
+MwNode mw_node_key(MwNode map, unsigned index);
+MwNode mw_node_value(MwNode map, unsigned index);
+/*
+ * Get items of array or map.
+ */
+
+bool mw_node_get(MwNode map, char* key, MwNode* value);
+/*
+ * Find value by string `key` and write it to `value`.
+ * Return false if not found.
+ *
+ * Keys are sorted when snapshot is compiled, lookup takes logarithmic time.
+ */
+
+PwResult mw_node_to_value(MwNode node);
+/*
+ * Convert node to PetWay value, recursively.
+ *
+ * Return MW_BAD_SNAPSHOT if nesting is too deep, which may be caused
+ * by cyclic references in a malformed snapshot, or if the number of converted
+ * nodes exceeds what the snapshot could hold without shared arrays and maps.
+ */
+
+/*
+ * Persistent parse cache
+ */
+
+typedef struct {
+    char*  directory;     // must exist
+    size_t max_size;      // total size of cache entries, zero for unlimited
+    bool   hash_content;  // identify files by content hash instead of path, size, and mtime
+
+    size_t estimated_size;  // internal, accessed atomically: total size of entries, zero if not known yet
+} MwParseCache;
+
+PwResult mw_parse_file_cached(MwParseCache* cache, char* path);
+/*
+ * Parse file at `path` or load previously parsed result from `cache`.
+ *
+ * Entries are snapshots named after SHA-256 of path and source id,
+ * which is either SHA-256 of the content or of path, device, inode, size,
+ * and modification time. Entries store path and source id, which are
+ * compared on load. The source id is calculated from the same
+ * opened file that is parsed on cache miss, and in the latter mode the result
+ * is not stored if the file was modified while reading.
+ *
+ * Changed files get new entries and stale ones are evicted eventually,
+ * least recently used first, when `max_size` is exceeded. The cache directory
+ * is scanned only when the running estimate of its size exceeds `max_size`.
+ *
+ * Failure to store entry is not an error, results that contain values
+ * not supported by snapshots are simply not cached.
+ */
+
+PwResult mw_reparse(PwValuePtr previous_tree, PwValuePtr old_text, PwValuePtr new_text);
+/*
+ * Parse `new_text` reusing values from `previous_tree` parsed from `old_text`.
+ *
+ * If the tree is a map, top-level entries are compared by text
+ * and only changed entries are parsed. Unchanged values are shared
+ * with the previous tree.
+ *
+ * Otherwise, or if top-level blocks cannot be matched with map entries,
+ * or a changed block cannot be parsed alone, or either text uses
+ * :anchor:, :ref:, or :include:, the whole `new_text` is parsed.
+ */
+
+/*
+ * Hot-reload watcher
+ */
+
+#define MW_WATCHER_MAX_READERS  128
+
+typedef struct _MwWatcher MwWatcher;
+
+typedef PwResult (*MwValidateFunc)(PwValuePtr tree, void* arg);
+typedef void (*MwReloadErrorFunc)(PwValuePtr status, void* arg);
+
+PwResult mw_watcher_start(char* path, MwValidateFunc validate, MwReloadErrorFunc on_error, void* arg,
+                          MwWatcher** result);
+/*
+ * Parse file at `path` and start watching it.
+ *
+ * When the file changes, it is parsed in background thread and,
+ * if `validate` is not null and returns success, the new tree replaces
+ * the current one. Invalid trees are discarded and, if `on_error` is not null,
+ * it is called in the background thread with the status of failed reload.
+ * Both callbacks receive `arg`.
+ *
+ * The path may go through symbolic links, their replacement is detected
+ * if they are in the same directory as the file, e.g. Kubernetes ConfigMap volumes.
+ *
+ * Return error if initial parsing or validation failed.
+ */
+
+void mw_watcher_stop(MwWatcher** watcher_ptr);
+/*
+ * Stop watching and free all trees. There must be no active readers.
+ * The format of the argument is natural for gnu::cleanup attribute.
+ */
+
+int mw_watcher_register_reader(MwWatcher* watcher);
+/*
+ * Register reader thread and return its slot, or -1 if all MW_WATCHER_MAX_READERS are taken.
+ */
+
+void mw_watcher_unregister_reader(MwWatcher* watcher, int reader);
+
+PwValuePtr mw_watcher_enter(MwWatcher* watcher, int reader);
+/*
+ * Return current tree. This is wait-free and the tree stays valid
+ * until mw_watcher_leave is called.
+ *
+ * Trees are immutable and shared by threads. Readers must not modify,
+ * clone, or destroy values because reference counts are not atomic.
+ */
+
+void mw_watcher_leave(MwWatcher* watcher, int reader);
+
+uint64_t mw_watcher_generation(MwWatcher* watcher);
+/*
+ * Return the number of published trees, starting from 1 for the initial one.
+ * Readers can compare it with the value they saw to detect reloads.
+ */
+
+/*
+ * Output
+ */
+
+#define MW_SINK_BUFFER_SIZE  (64 * 1024)
+
+typedef struct {
+    /*
+     * Buffered output.
+     */
+    int    fd;        // -1 to collect output in `data`
+    char*  data;
+    size_t length;
+    size_t capacity;
+} MwSink;
+
+PwResult mw_sink_init(MwSink* sink, int fd, size_t buffer_size);
+/*
+ * Initialize sink that writes to `fd` when buffer is full,
+ * or grows the buffer if `fd` is -1.
+ *
+ * If `buffer_size` is zero, MW_SINK_BUFFER_SIZE is used.
+ */
+
+void mw_sink_fini(MwSink* sink);
+/*
+ * Free sink buffer. Data is not flushed.
+ */
+
+PwResult mw_sink_write(MwSink* sink, char* data, size_t size);
+/*
+ * Append data to the buffer. Data larger than the buffer is written
+ * to file descriptor along with buffered data by single writev call, without copying.
+ */
+
+PwResult mw_sink_flush(MwSink* sink);
+/*
+ * Write buffered data to file descriptor. No op for sinks without descriptor.
+ */
+
+typedef struct {
+    unsigned indent;         // indentation of nested blocks, 4 if zero
+    bool     quote_strings;  // always write strings quoted
+} MwDumpOptions;
+
+PwResult mw_dump(PwValuePtr value, MwSink* sink, MwDumpOptions* options);
+/*
+ * Write `value` to `sink` as MYAW markup and flush the sink.
+ * `options` can be nullptr.
+ *
+ * Strings are written as literal if possible, multi-line ones
+ * as :literal: blocks, otherwise quoted with escapes.
+ * Empty lists and maps are written as :json: values.
+ *
+ * The output parses back to the same value, except that unsigned integers
+ * that fit into signed type are parsed back as signed ones.
+ *
+ * Date/time, timestamp, non-finite floats, and lists or maps as map keys
+ * are not supported, MW_UNSUPPORTED_TYPE is returned for them.
+ */
+
+PwResult mw_transcode_json(PwValuePtr markup, MwSink* sink);
+/*
+ * Convert MYAW `markup` to JSON without building the tree and write it to `sink`.
+ * Memory usage depends on nesting depth, not on the size of markup,
+ * except for values of :json: and custom conversion specifiers, which are parsed as a whole.
+ *
+ * Map keys other than strings are converted to strings.
+ * Date/time and timestamp values are not supported.
+ */
+
+/*
+ * Columnar extraction
+ */
+
+#define MW_MAX_COLUMNS  64
+
+typedef enum {
+    MW_COLUMN_INT64,    // int64_t
+    MW_COLUMN_FLOAT64,  // double, integers are converted
+    MW_COLUMN_STRING    // UTF-8 strings stored in arena
+} MwColumnType;
+
+typedef struct {
+    char*        name;  // key of record
+    MwColumnType type;
+
+    // extracted data, free with mw_column_fini
+    unsigned length;    // number of rows
+    unsigned capacity;
+    union {
+        void*    values;
+        int64_t* int64_values;
+        double*  float64_values;
+        size_t*  string_offsets;
+        /*
+         * Offsets of strings in arena, `length` + 1 items.
+         * String of row i spans from string_offsets[i] to string_offsets[i + 1].
+         */
+    };
+    uint8_t* nulls;     // bitmap, bit is set if value is null or key is missing
+    MwSink   arena;     // string data
+} MwColumn;
+
+PwResult mw_extract_columns(PwValuePtr markup, MwColumn* columns, unsigned num_columns);
+/*
+ * Parse `markup` which must be a list of maps (records) and write
+ * values of keys listed in `columns` to column buffers, one row per record.
+ *
+ * Only `name` and `type` of columns must be set, the rest is initialized
+ * by this function. Values of other keys are skipped without parsing.
+ * Null values and missing keys are marked in `nulls` bitmap and stored
+ * as zeroes or empty strings.
+ *
+ * Return success or error. Columns must be freed in any case.
+ */
+
+PwResult mw_parser_extract_columns(MwParser* parser, MwColumn* columns, unsigned num_columns);
+/*
+ * Same as mw_extract_columns but use existing `parser`, e.g. with limits set.
+ */
+
+void mw_column_fini(MwColumn* column);
+/*
+ * Free column data.
+ */
+
+#define mw_column_is_null(column, row)  ((column)->nulls[(row) >> 3] & (1 << ((row) & 7)))
+
+/*
+ * Runtime tracing
+ */
+
+#define MW_TRACE_BUFFER_SIZE  16384  // events per thread, must be power of 2
+
+typedef struct {
+    char*    name;          // static string, nullptr if tracing was disabled at span start
+    unsigned line_number;
+    uint64_t start_ns;
+    char     detail[24];    // conversion specifier for custom parsers
+} MwTraceSpan;
+
+void mw_trace_enable(bool enable);
+/*
+ * Turn tracing on or off for all threads.
+ *
+ * When enabled, parser routines record spans with timestamps and line numbers
+ * to per-thread ring buffers. The oldest events are overwritten when a buffer is full.
+ */
+
+PwResult mw_trace_export(MwSink* sink);
+/*
+ * Write recorded events to `sink` in Chrome trace JSON format
+ * which can be loaded into chrome://tracing or Perfetto UI.
+ *
+ * Tracing may stay enabled while exporting, events that running threads
+ * overwrite in the meantime are skipped.
+ */
+
+void mw_trace_clear();
+/*
+ * Discard recorded events and free buffers of finished threads.
+ */
+
+extern bool _mw_trace_enabled;
+
+MwTraceSpan _mw_trace_span_begin(char* name, unsigned line_number);
+void _mw_trace_span_end(MwTraceSpan* span);
+void _mw_trace_span_detail(MwTraceSpan* span, PwValuePtr str);
+
+#define MW_TRACE_SPAN(name, line_number)  \
+    [[ gnu::cleanup(_mw_trace_span_end) ]] MwTraceSpan _mw_trace_span =  \
+        __atomic_load_n(&_mw_trace_enabled, __ATOMIC_RELAXED)?  \
+            _mw_trace_span_begin((name), (line_number)) : (MwTraceSpan) {}
+/*
+ * Start span that ends when current scope is left.
+ */
+
+PwResult _mw_sink_reserve(MwSink* sink, size_t size, char** ptr);
+/*
+ * Make sure sink buffer has space for `size` bytes and write pointer to it.
+ * The caller writes data and increments `sink->length`.
+ */
+
+PwResult _mw_sink_write_char(MwSink* sink, char32_t chr);
+/*
+ * Write character encoded as UTF-8.
+ */
+
+PwResult _mw_sink_write_quoted(MwSink* sink, PwValuePtr str);
+/*
+ * Write string in double quotes with JSON escapes.
+ */
+
+PwResult _mw_sink_write_number(MwSink* sink, PwValuePtr value);
+/*
+ * Write number. Floats always contain decimal point or exponent.
+ * Return MW_UNSUPPORTED_TYPE if value is not a number or is not finite.
+ */
+
 PwResult _mw_json_parser_func(MwParser* parser);
 /*
  * JSON parser function for MW :json: conversion specifier.
  */
 
+PwResult _mw_include_parser_func(MwParser* parser);
+/*
+ * Parser function for :include: conversion specifier.
+ */
+
+#define MW_DIGEST_SIZE  65  // SHA-256 as hex string, including terminating null
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t  block[64];
+    unsigned block_len;
+} MwSha256;
+
+void _mw_sha256_init(MwSha256* ctx);
+void _mw_sha256_update(MwSha256* ctx, void* data, size_t size);
+void _mw_sha256_final(MwSha256* ctx, char* digest);
+/*
+ * Calculate SHA-256 and write it to `digest` as hex string of MW_DIGEST_SIZE.
+ */
+
+PwResult _mw_read_fd(int fd, PwValuePtr text, char* digest);
+/*
+ * Read regular file opened as `fd` to `text` and write SHA-256 of its content to `digest`.
+ * Files of other types, e.g. devices and FIFOs, are rejected with EINVAL.
+ * The descriptor is not closed.
+ */
+
+PwResult _mw_int64_array_parser_func(MwParser* parser);
+PwResult _mw_float64_array_parser_func(MwParser* parser);
+/*
+ * Parser functions for :int64[]: and :float64[]: conversion specifiers.
+ */
+
 PwResult _mw_read_block_line(MwParser* parser);
 /*
  * Read line belonging to a block, until indent is less than `block_indent`.
@@ -106,6 +991,102 @@ bool _mw_end_of_block(PwValuePtr status);
 PwResult _mw_read_block(MwParser* parser);
 /*
  * Read lines starting from current_line till the end of block.
+ * Lines are copied, custom parsers should prefer block reader.
+ */
+
+PwResult _mw_start_nested_block(MwParser* parser, unsigned block_pos, unsigned* saved_block_indent);
+/*
+ * Start nested block: set block indent to `block_pos` and save previous one
+ * to `saved_block_indent`.
+ */
+
+PwResult _mw_start_nested_block_from_next_line(MwParser* parser, unsigned* saved_block_indent);
+/*
+ * Read next line and start nested block with indent incremented by one.
+ */
+
+void _mw_end_nested_block(MwParser* parser, unsigned saved_block_indent);
+/*
+ * End nested block started by one of the above functions.
+ */
+
+PwResult _mw_count_node(MwParser* parser);
+/*
+ * Count list item, map entry, JSON array item or object member,
+ * and check limits.
+ */
+
+void _mw_count_value(MwParser* parser, PwValuePtr value);
+/*
+ * Update statistics for scalar value added to container.
+ * Lists and maps are counted when created.
+ */
+
+void _mw_count_container(MwParser* parser, MwStatsValueType type);
+
+PwResult _mw_skip_value(MwParser* parser, unsigned key_indent);
+/*
+ * Skip value of map key without parsing it.
+ * All lines with indent greater than `key_indent` belong to the value.
+ */
+
+PwResult _mw_parse_value(MwParser* parser, unsigned* nested_value_pos, PwValuePtr convspec_out);
+/*
+ * Parse value starting from the current block position.
+ *
+ * If `nested_value_pos` is provided, the value is expected to be a map key.
+ * On success write position of the value that follows the key to it
+ * and write conversion specifier to `convspec_out`, if any.
+ */
+
+PwResult _mw_parse_key(MwParser* parser, unsigned* key_start, unsigned* key_end,
+                       unsigned* value_pos, PwValuePtr convspec_out);
+/*
+ * Find map key starting from the current block position without allocating it.
+ *
+ * Write the span of the key in `current_line` to `key_start` and `key_end`,
+ * quotation marks excluded, and the position of the value to `value_pos`.
+ * Write conversion specifier to `convspec_out`, if any.
+ */
+
+MwBlockParserFunc _mw_get_custom_parser(MwParser* parser, PwValuePtr convspec);
+/*
+ * Return parser function for `convspec`, which must be defined.
+ */
+
+/*
+ * Helpers for parsers generated by myaw_codegen.
+ *
+ * `value_pos` and `convspec` are obtained from _mw_parse_key.
+ * Values are parsed as nested blocks, same as for mw_parse_into.
+ */
+
+typedef PwResult (*MwBindFunc)(MwParser* parser, void* out);
+/*
+ * Parse map starting from the current block position into structure `out`.
+ */
+
+PwResult _mw_bind_scalar(MwParser* parser, unsigned value_pos, PwValuePtr convspec,
+                         MwFieldType type, char* name, void* out);
+/*
+ * Parse single-line boolean or number, convert it to `type` and write to `out`.
+ * Conversion specifiers are not allowed. `name` is used in error messages.
+ */
+
+PwResult _mw_bind_value(MwParser* parser, unsigned value_pos, PwValuePtr convspec, PwValuePtr out);
+/*
+ * Parse any value and move it to `out`, destroying previous one.
+ */
+
+PwResult _mw_bind_struct(MwParser* parser, unsigned value_pos, PwValuePtr convspec,
+                         char* name, MwBindFunc bind_func, void* out);
+/*
+ * Parse nested structure with `bind_func`.
+ */
+
+PwResult _mw_bind_document(MwParser* parser, MwBindFunc bind_func, void* out);
+/*
+ * Parse top-level map with `bind_func`, same as mw_parser_parse_into does.
  */
 
 unsigned _mw_get_start_position(MwParser* parser);
@@ -139,6 +1120,38 @@ bool _mw_find_closing_quote(PwValuePtr line, char32_t quote, unsigned start_pos,
  * If found, write its position to `end_pos` and return true;
  */
 
+uint8_t _mw_substr_char_size(PwValuePtr str, unsigned start_pos, unsigned end_pos);
+/*
+ * Return minimal char size required to store substring of `str`
+ * from `start_pos` to `end_pos`.
+ */
+
+char32_t _mw_decode_utf8(uint8_t** ptr, uint8_t* end);
+/*
+ * Decode one character and advance `ptr`.
+ * Return replacement character for invalid sequences.
+ */
+
+PwResult _mw_create_string(char* data, size_t length);
+/*
+ * Decode UTF-8 `data` which may contain zero bytes.
+ * `data[length]` must be zero.
+ */
+
+unsigned _mw_value_end(PwValuePtr line, unsigned start_pos);
+/*
+ * Return end position of single-line value that starts at `start_pos`,
+ * excluding trailing comment and spaces. The comment must be separated
+ * from the value by space.
+ */
+
+PwResult _mw_substr(PwValuePtr str, unsigned start_pos, unsigned end_pos);
+/*
+ * Same as pw_substr but the result has minimal char size.
+ * The current line widens to its widest character, and substrings
+ * of pure ASCII would take 2-4 bytes per character otherwise.
+ */
+
 PwResult _mw_unescape_line(MwParser* parser, PwValuePtr line, unsigned line_number,
                             char32_t quote, unsigned start_pos, unsigned end_pos);
 /*
@@ -163,6 +1176,13 @@ PwResult _mw_parse_json_value(MwParser* parser, unsigned start_pos, unsigned* en
  * On success write position where parsing stopped to `end_pos`.
  */
 
+PwResult _mw_read_line_part(MwParser* parser, unsigned* pos);
+/*
+ * Read next part of the current line if `line_continues` is set.
+ * Characters before `pos` are dropped from `current_line`,
+ * the rest is kept and `pos` is set to the position of the first of them.
+ */
+
 #ifdef __cplusplus
 }
 #endif
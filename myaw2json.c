@@ -0,0 +1,43 @@
+/*
+ * Convert MYAW to JSON.
+ *
+ * Usage: myaw2json [file.myaw]
+ *
+ * Read standard input if file is not given and write JSON to standard output.
+ * The tree is not built, so files of any size can be converted.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <myaw.h>
+
+int main(int argc, char* argv[])
+{
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [file.myaw]\n", argv[0]);
+        return 1;
+    }
+
+    PWDECL_CharPtr(input_path, (argc == 2)? argv[1] : "/dev/stdin");
+    PwValue file = pw_file_open(&input_path, O_RDONLY, 0);
+    if (pw_error(&file)) {
+        pw_print_status(stderr, &file);
+        return 1;
+    }
+
+    MwSink sink;
+    PwValue status = mw_sink_init(&sink, STDOUT_FILENO, 0);
+    if (pw_error(&status)) {
+        pw_print_status(stderr, &status);
+        return 1;
+    }
+    status = mw_transcode_json(&file, &sink);
+    mw_sink_fini(&sink);
+    if (pw_error(&status)) {
+        pw_print_status(stderr, &status);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include <myaw.h>
+
+/*
+ * Batch parsing with work stealing.
+ *
+ * Each worker owns a range of input indexes packed into atomic 64-bit value
+ * (low index in upper half, high index in lower half).
+ * The owner takes items from the low end, thieves take upper half
+ * of the remaining range and make it their own.
+ */
+
+#define MAX_BATCH_THREADS  256
+
+typedef struct _Batch Batch;
+
+typedef struct {
+    Batch*           batch;
+    _Atomic uint64_t range;
+    pthread_t        thread;
+} Worker;
+
+struct _Batch {
+    PwValuePtr inputs;
+    PwValuePtr results;
+    Worker*    workers;
+    unsigned   num_workers;
+};
+
+static inline uint64_t make_range(unsigned lo, unsigned hi)
+{
+    return (((uint64_t) lo) << 32) | hi;
+}
+
+static inline unsigned range_lo(uint64_t range)
+{
+    return (unsigned) (range >> 32);
+}
+
+static inline unsigned range_hi(uint64_t range)
+{
+    return (unsigned) range;
+}
+
+static bool take_item(Worker* worker, unsigned* index)
+{
+    uint64_t range = atomic_load(&worker->range);
+    for (;;) {
+        unsigned lo = range_lo(range);
+        unsigned hi = range_hi(range);
+        if (lo >= hi) {
+            return false;
+        }
+        if (atomic_compare_exchange_weak(&worker->range, &range, make_range(lo + 1, hi))) {
+            *index = lo;
+            return true;
+        }
+    }
+}
+
+static bool steal_items(Worker* thief)
+/*
+ * Move upper half of some other worker's range to `thief`.
+ * Return false if there's nothing left.
+ */
+{
+    Batch* batch = thief->batch;
+    unsigned self = (unsigned) (thief - batch->workers);
+    for (unsigned i = 1; i < batch->num_workers; i++) {
+        Worker* victim = &batch->workers[(self + i) % batch->num_workers];
+        uint64_t range = atomic_load(&victim->range);
+        for (;;) {
+            unsigned lo = range_lo(range);
+            unsigned hi = range_hi(range);
+            if (lo >= hi) {
+                break;
+            }
+            unsigned mid = hi - (hi - lo + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &range, make_range(lo, mid))) {
+                // thief's range is empty, nobody steals from it now
+                atomic_store(&thief->range, make_range(mid, hi));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void* worker_thread(void* arg)
+{
+    Worker* worker = arg;
+    Batch* batch = worker->batch;
+    MwParser* parser = nullptr;
+
+    for (;;) {
+        unsigned index;
+        if (!take_item(worker, &index)) {
+            if (steal_items(worker)) {
+                continue;
+            }
+            break;
+        }
+        PwValuePtr input = &batch->inputs[index];
+        PwValuePtr result = &batch->results[index];
+
+        pw_destroy(result);
+
+        // parser is created once and reused for subsequent inputs
+        if (parser) {
+            PwValue status = mw_reset_parser(parser, input);
+            if (pw_error(&status)) {
+                *result = pw_move(&status);
+                continue;
+            }
+        } else {
+            parser = mw_create_parser(input);
+            if (!parser) {
+                *result = PwOOM();
+                continue;
+            }
+        }
+        *result = mw_parser_parse(parser);
+    }
+    if (parser) {
+        mw_delete_parser(&parser);
+    }
+    return nullptr;
+}
+
+PwResult mw_parse_batch(PwValuePtr inputs, unsigned n, PwValuePtr results, unsigned nthreads)
+{
+    if (n == 0) {
+        return PwOK();
+    }
+    if (nthreads == 0) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = (ncpus > 0)? (unsigned) ncpus : 1;
+    }
+    if (nthreads > n) {
+        nthreads = n;
+    }
+    if (nthreads > MAX_BATCH_THREADS) {
+        nthreads = MAX_BATCH_THREADS;
+    }
+
+    Worker workers[MAX_BATCH_THREADS];
+    Batch batch = {
+        .inputs      = inputs,
+        .results     = results,
+        .workers     = workers,
+        .num_workers = nthreads
+    };
+
+    // split inputs evenly
+    for (unsigned i = 0; i < nthreads; i++) {
+        unsigned lo = (unsigned) ((uint64_t) n * i / nthreads);
+        unsigned hi = (unsigned) ((uint64_t) n * (i + 1) / nthreads);
+        workers[i].batch = &batch;
+        atomic_init(&workers[i].range, make_range(lo, hi));
+    }
+
+    // calling thread is worker 0
+    unsigned started = 1;
+    for (; started < nthreads; started++) {
+        if (pthread_create(&workers[started].thread, nullptr, worker_thread, &workers[started])) {
+            // ranges of workers that failed to start will be stolen by running ones
+            break;
+        }
+    }
+    worker_thread(&workers[0]);
+
+    for (unsigned i = 1; i < started; i++) {
+        pthread_join(workers[i].thread, nullptr);
+    }
+    return PwOK();
+}
@@ -0,0 +1,667 @@
+/*
+ * Throughput benchmark.
+ *
+ * Usage: myaw_bench [-s size_mb] [-n iterations] [-m mode] [-c corpus]
+ *
+ * Generate synthetic corpora with a fixed seed, parse each one by every mode
+ * that accepts it, and write one JSON line per run to standard output:
+ *
+ *   {"mode":"mw_parse","corpus":"records","bytes":8388708,"values":1398120,"iterations":5,
+ *    "best_seconds":0.21,"mean_seconds":0.22,"mb_per_s":39.9,"values_per_s":6657714,"peak_rss_kb":412340}
+ *
+ * Throughput is calculated from the best iteration.
+ * Peak RSS is reported for the whole process and never decreases,
+ * use -m and -c to measure a single run.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <myaw.h>
+
+#define SEED          0x9E3779B97F4A7C15ULL
+#define MAP_DEPTH     16
+#define BLOCK_LINES   24
+#define ARRAY_LENGTH  32
+
+typedef struct {
+    MwSink   sink;
+    uint64_t rng;
+    uint64_t values;  // number of values in the corpus, map keys are not counted
+    size_t   size;    // minimal size of the corpus
+    size_t   bytes;   // actual size of the corpus
+} Corpus;
+
+typedef struct {
+    char* name;
+    PwResult (*generate)(Corpus* corpus);
+    bool  json;       // corpus is JSON, not MYAW
+} CorpusType;
+
+typedef struct {
+    char* name;
+    PwResult (*parse)(PwValuePtr markup);
+    bool  json;       // mode accepts JSON corpora
+    char* corpora;    // space separated names of accepted corpora, all if nullptr
+} Mode;
+
+static uint64_t random_number(Corpus* corpus)
+/*
+ * xorshift64, same sequence on all platforms
+ */
+{
+    uint64_t x = corpus->rng;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    corpus->rng = x;
+    return x;
+}
+
+static unsigned random_below(Corpus* corpus, unsigned n)
+/*
+ * Order of evaluation of function arguments is unspecified,
+ * so random numbers are never drawn in argument lists.
+ */
+{
+    return (unsigned) (random_number(corpus) % n);
+}
+
+static bool corpus_full(Corpus* corpus)
+{
+    return corpus->sink.length >= corpus->size;
+}
+
+static PwResult emit(Corpus* corpus, char* format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    int n = vsnprintf(nullptr, 0, format, ap);
+    va_end(ap);
+    if (n < 0) {
+        return PwErrno(errno);
+    }
+    char* ptr;
+    PwValue status = _mw_sink_reserve(&corpus->sink, n + 1, &ptr);
+    pw_return_if_error(&status);
+
+    va_start(ap, format);
+    vsnprintf(ptr, n + 1, format, ap);
+    va_end(ap);
+    corpus->sink.length += n;
+    return PwOK();
+}
+
+static char* words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+    "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore", "magna"
+};
+
+static PwResult emit_words(Corpus* corpus, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {{
+        char* word = words[random_below(corpus, sizeof(words) / sizeof(words[0]))];
+        PwValue status = emit(corpus, "%s%s", i? " " : "", word);
+        pw_return_if_error(&status);
+    }}
+    return PwOK();
+}
+
+static PwResult generate_deep_maps(Corpus* corpus)
+/*
+ * Sections of maps nested MAP_DEPTH levels deep.
+ */
+{
+    corpus->values++;  // root map
+    for (unsigned n = 0; !corpus_full(corpus); n++) {{
+        PwValue status = emit(corpus, "section_%u:\n", n);
+        pw_return_if_error(&status);
+        corpus->values++;
+
+        for (unsigned depth = 1; depth <= MAP_DEPTH; depth++) {
+            unsigned indent = depth * 4;
+            unsigned id = random_below(corpus, 1000000);
+            unsigned node = random_below(corpus, 1000);
+            status = emit(corpus, "%*sid: %u\n%*sname: node %u\n", indent, "", id, indent, "", node);
+            pw_return_if_error(&status);
+            corpus->values += 2;
+
+            if (depth < MAP_DEPTH) {
+                status = emit(corpus, "%*schild:\n", indent, "");
+                pw_return_if_error(&status);
+                corpus->values++;
+            }
+        }
+    }}
+    return PwOK();
+}
+
+static PwResult generate_records(Corpus* corpus)
+/*
+ * Long list of flat records.
+ */
+{
+    corpus->values++;  // root list
+    for (unsigned n = 0; !corpus_full(corpus); n++) {{
+        unsigned score = random_below(corpus, 10000);
+        bool active = random_below(corpus, 2);
+        PwValue status = emit(corpus,
+            "- id: %u\n"
+            "  name: user %u\n"
+            "  email: user%u@example.com\n"
+            "  score: %u.%02u\n"
+            "  active: %s\n",
+            n, n, n, score / 100, score % 100, active? "true" : "false"
+        );
+        pw_return_if_error(&status);
+        corpus->values += 6;
+    }}
+    return PwOK();
+}
+
+static PwResult generate_blocks(Corpus* corpus)
+/*
+ * Big literal and folded blocks.
+ */
+{
+    corpus->values++;  // root map
+    for (unsigned n = 0; !corpus_full(corpus); n++) {{
+        PwValue status = emit(corpus, "%s_%u: :%s:\n",
+                              (n & 1)? "folded" : "literal", n, (n & 1)? "folded" : "literal");
+        pw_return_if_error(&status);
+        corpus->values++;
+
+        for (unsigned i = 0; i < BLOCK_LINES; i++) {
+            // literal blocks keep relative indentation
+            unsigned indent = (n & 1)? 4 : 4 + random_below(corpus, 4);
+            status = emit(corpus, "%*s", indent, "");
+            pw_return_if_error(&status);
+
+            unsigned num_words = 6 + random_below(corpus, 8);
+            status = emit_words(corpus, num_words);
+            pw_return_if_error(&status);
+
+            status = emit(corpus, "\n");
+            pw_return_if_error(&status);
+        }
+    }}
+    return PwOK();
+}
+
+static PwResult generate_quoted(Corpus* corpus)
+/*
+ * Quoted strings with escapes, single- and multi-line.
+ */
+{
+    corpus->values++;  // root map
+    for (unsigned n = 0; !corpus_full(corpus); n++) {{
+        unsigned number = random_below(corpus, 1000000);
+        PwValue status = emit(corpus,
+            "message_%u: \"tab\\there, \\\"quotes\\\", backslash \\\\ and \\u00e9t\\u00e9 %u\\n\"\n"
+            "multiline_%u:\n"
+            "    \"first line\\n\n"
+            "     second \\u2603 line\\n\n"
+            "     third line\"\n",
+            n, number, n
+        );
+        pw_return_if_error(&status);
+        corpus->values += 2;
+    }}
+    return PwOK();
+}
+
+static PwResult generate_numbers(Corpus* corpus)
+/*
+ * Integers and floats in various forms.
+ */
+{
+    corpus->values++;  // root map
+    for (unsigned n = 0; !corpus_full(corpus); n++) {{
+        unsigned r[10];
+        r[0] = (unsigned) random_number(corpus);
+        r[1] = random_below(corpus, 100000);
+        r[2] = random_below(corpus, 552);
+        r[3] = random_below(corpus, 1000);
+        r[4] = random_below(corpus, 1000);
+        r[5] = random_below(corpus, 1000000);
+        r[6] = random_below(corpus, 1000);
+        r[7] = random_below(corpus, 300);
+        r[8] = random_below(corpus, 1000);
+        r[9] = (unsigned) random_number(corpus);
+
+        PwValue status = emit(corpus,
+            "int_%u: %u\n"
+            "negative_%u: -%u\n"
+            "big_%u: 18'446'744'073'709'%03u'615\n"
+            "grouped_%u: 1_000_%03u\n"
+            "float_%u: %u.%06u\n"
+            "exp_%u: -%u.%02ue%u\n"
+            "list_%u:\n"
+            "    - %u\n"
+            "    - %u.5\n"
+            "    - -%u\n",
+            n, r[0],
+            n, r[1],
+            n, r[2],
+            n, r[3],
+            n, r[4], r[5],
+            n, r[6] / 100, r[6] % 100, r[7],
+            n, r[8], r[8] + 1, r[9]
+        );
+        pw_return_if_error(&status);
+        corpus->values += 10;
+    }}
+    return PwOK();
+}
+
+static PwResult generate_datetimes(Corpus* corpus)
+/*
+ * Date/time and timestamp values.
+ */
+{
+    corpus->values++;  // root map
+    for (unsigned n = 0; !corpus_full(corpus); n++) {{
+        unsigned r[10];
+        r[0] = 1970 + random_below(corpus, 100);
+        r[1] = 1 + random_below(corpus, 12);
+        r[2] = 1 + random_below(corpus, 28);
+        r[3] = random_below(corpus, 24);
+        r[4] = random_below(corpus, 60);
+        r[5] = random_below(corpus, 60);
+        r[6] = random_below(corpus, 1000000);
+        r[7] = random_below(corpus, 12 * 28);
+        r[8] = 1000000000 + random_below(corpus, 1000000000);
+        r[9] = random_below(corpus, 1000000000);
+
+        PwValue status = emit(corpus,
+            "created_%u: :datetime: %04u-%02u-%02uT%02u:%02u:%02u.%06uZ\n"
+            "date_%u: :datetime: %04u%02u%02u\n"
+            "updated_%u: :timestamp: %u.%09u\n",
+            n, r[0], r[1], r[2], r[3], r[4], r[5], r[6],
+            n, r[0], 1 + r[7] / 28, 1 + r[7] % 28,
+            n, r[8], r[9]
+        );
+        pw_return_if_error(&status);
+        corpus->values += 3;
+    }}
+    return PwOK();
+}
+
+static PwResult emit_json_record(Corpus* corpus, unsigned n)
+{
+    unsigned score = random_below(corpus, 10000);
+    bool active = random_below(corpus, 2);
+    corpus->values += 8;
+    return emit(corpus,
+        "{\"id\": %u, \"name\": \"user \\\"%u\\\"\", \"score\": %u.%02u, "
+        "\"tags\": [\"alpha\", \"beta\"], \"active\": %s}",
+        n, n, score / 100, score % 100, active? "true" : "false"
+    );
+}
+
+static PwResult generate_json_payloads(Corpus* corpus)
+/*
+ * :json: values embedded in MYAW.
+ */
+{
+    corpus->values++;  // root map
+    for (unsigned n = 0; !corpus_full(corpus); n++) {{
+        PwValue status = emit(corpus, "payload_%u: :json: ", n);
+        pw_return_if_error(&status);
+
+        status = emit_json_record(corpus, n);
+        pw_return_if_error(&status);
+
+        status = emit(corpus, "\n");
+        pw_return_if_error(&status);
+    }}
+    return PwOK();
+}
+
+static PwResult generate_json(Corpus* corpus)
+/*
+ * Plain JSON array of records, one per line.
+ */
+{
+    corpus->values++;  // root array
+    PwValue status = emit(corpus, "[\n");
+    pw_return_if_error(&status);
+
+    for (unsigned n = 0; !corpus_full(corpus); n++) {
+        if (n) {
+            status = emit(corpus, ",\n");
+            pw_return_if_error(&status);
+        }
+        status = emit_json_record(corpus, n);
+        pw_return_if_error(&status);
+    }
+    return emit(corpus, "\n]\n");
+}
+
+static PwResult generate_config(Corpus* corpus)
+/*
+ * Single map of known keys with a long list of hosts, for mw_parse_into.
+ */
+{
+    corpus->values++;  // root map
+    PwValue status = emit(corpus,
+        "name: bench\n"
+        "port: 8080\n"
+        "ratio: 0.75\n"
+        "enabled: true\n"
+        "hosts:\n"
+    );
+    pw_return_if_error(&status);
+    corpus->values += 5;
+
+    for (unsigned n = 0; !corpus_full(corpus); n++) {
+        unsigned weight = random_below(corpus, 100);
+        status = emit(corpus,
+            "    - host: node%u.example.com\n"
+            "      weight: %u\n",
+            n, weight
+        );
+        pw_return_if_error(&status);
+        corpus->values += 3;
+    }
+    return PwOK();
+}
+
+static PwResult generate_json_arrays(Corpus* corpus)
+/*
+ * JSON array of numeric arrays, integer and float ones in turn.
+ */
+{
+    corpus->values++;  // root array
+    PwValue status = emit(corpus, "[\n");
+    pw_return_if_error(&status);
+
+    for (unsigned n = 0; !corpus_full(corpus); n++) {
+        status = emit(corpus, "%s[", n? ",\n" : "");
+        pw_return_if_error(&status);
+
+        for (unsigned i = 0; i < ARRAY_LENGTH; i++) {
+            unsigned number = random_below(corpus, 1000000);
+            if (n & 1) {
+                status = emit(corpus, "%s%u.%02u", i? ", " : "", number / 100, number % 100);
+            } else {
+                status = emit(corpus, "%s%u", i? ", " : "", number);
+            }
+            pw_return_if_error(&status);
+        }
+        status = emit(corpus, "]");
+        pw_return_if_error(&status);
+        corpus->values += ARRAY_LENGTH + 1;
+    }
+    return emit(corpus, "\n]\n");
+}
+
+static CorpusType corpus_types[] = {
+    { "deep_maps",     generate_deep_maps,     false },
+    { "records",       generate_records,       false },
+    { "blocks",        generate_blocks,        false },
+    { "quoted",        generate_quoted,        false },
+    { "numbers",       generate_numbers,       false },
+    { "datetimes",     generate_datetimes,     false },
+    { "json_payloads", generate_json_payloads, false },
+    { "config",        generate_config,        false },
+    { "json",          generate_json,          true  },
+    { "json_arrays",   generate_json_arrays,   true  }
+};
+
+static PwResult transcode_json(PwValuePtr markup)
+{
+    [[ gnu::cleanup(mw_sink_fini) ]] MwSink sink;
+    PwValue status = mw_sink_init(&sink, -1, 0);
+    pw_return_if_error(&status);
+
+    return mw_transcode_json(markup, &sink);
+}
+
+static PwResult extract_columns(PwValuePtr markup)
+{
+    MwColumn columns[] = {
+        { .name = "id",    .type = MW_COLUMN_INT64   },
+        { .name = "email", .type = MW_COLUMN_STRING  },
+        { .name = "score", .type = MW_COLUMN_FLOAT64 }
+    };
+    unsigned num_columns = sizeof(columns) / sizeof(columns[0]);
+
+    PwValue status = mw_extract_columns(markup, columns, num_columns);
+    for (unsigned i = 0; i < num_columns; i++) {
+        mw_column_fini(&columns[i]);
+    }
+    return pw_move(&status);
+}
+
+typedef struct {
+    _PwValue name;
+    uint64_t port;
+    double   ratio;
+    bool     enabled;
+    _PwValue hosts;
+} Config;
+
+static MwSchemaField config_fields[] = {
+    { "name",    offsetof(Config, name),    MW_FIELD_VALUE,    nullptr, true  },
+    { "port",    offsetof(Config, port),    MW_FIELD_UNSIGNED, nullptr, true  },
+    { "ratio",   offsetof(Config, ratio),   MW_FIELD_FLOAT,    nullptr, false },
+    { "enabled", offsetof(Config, enabled), MW_FIELD_BOOL,     nullptr, false },
+    { "hosts",   offsetof(Config, hosts),   MW_FIELD_VALUE,    nullptr, true  }
+};
+
+static MwSchema config_schema = {
+    .fields = config_fields,
+    .num_fields = sizeof(config_fields) / sizeof(config_fields[0])
+};
+
+static PwResult parse_into(PwValuePtr markup)
+{
+    Config config = {
+        .name = PwNull(),
+        .hosts = PwNull()
+    };
+    PwValue status = mw_parse_into(markup, &config_schema, &config);
+    pw_destroy(&config.name);
+    pw_destroy(&config.hosts);
+    return pw_move(&status);
+}
+
+static PwResult parse_json_packed(PwValuePtr markup)
+{
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
+    if (!parser) {
+        return PwOOM();
+    }
+    parser->pack_json_arrays = true;
+    return mw_parser_parse_json(parser);
+}
+
+static Mode modes[] = {
+    // add new parsing modes here
+    { "mw_parse",             mw_parse,          false, nullptr },
+    { "mw_validate",          mw_validate,       false, nullptr },
+    // date/time values have no JSON representation
+    { "mw_transcode_json",    transcode_json,    false, "deep_maps records blocks quoted numbers json_payloads config" },
+    { "mw_extract_columns",   extract_columns,   false, "records" },
+    { "mw_parse_into",        parse_into,        false, "config" },
+    { "mw_parse_json",        mw_parse_json,     true,  nullptr },
+    { "mw_parse_json_packed", parse_json_packed, true,  nullptr }
+};
+
+#define NUM_CORPUS_TYPES  (sizeof(corpus_types) / sizeof(corpus_types[0]))
+#define NUM_MODES         (sizeof(modes) / sizeof(modes[0]))
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static PwResult generate_corpus(CorpusType* type, size_t size, Corpus* corpus, PwValuePtr text)
+{
+    corpus->rng = SEED;
+    corpus->values = 0;
+    corpus->size = size;
+    PwValue status = mw_sink_init(&corpus->sink, -1, 0);
+    pw_return_if_error(&status);
+
+    status = type->generate(corpus);
+    if (pw_ok(&status)) {
+        // terminate for pw_create_string, the terminator is not counted
+        char* terminator;
+        status = _mw_sink_reserve(&corpus->sink, 1, &terminator);
+        if (pw_ok(&status)) {
+            *terminator = 0;
+        }
+    }
+    if (pw_ok(&status)) {
+        pw_destroy(text);
+        *text = pw_create_string(corpus->sink.data);
+        if (pw_error(text)) {
+            status = pw_clone(text);
+        }
+    }
+    // the markup is parsed from `text`, free generated data to keep peak RSS honest
+    corpus->bytes = corpus->sink.length;
+    mw_sink_fini(&corpus->sink);
+    return pw_move(&status);
+}
+
+static PwResult run(Mode* mode, CorpusType* type, Corpus* corpus, PwValuePtr text, unsigned iterations)
+{
+    double best = 0.0;
+    double total = 0.0;
+    for (unsigned i = 0; i < iterations; i++) {{
+        PwValue reader = pw_create_string_io(text);
+        pw_return_if_error(&reader);
+
+        double start = now();
+        PwValue result = mode->parse(&reader);
+        double elapsed = now() - start;
+        pw_return_if_error(&result);
+
+        total += elapsed;
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }}
+    printf("{\"mode\":\"%s\",\"corpus\":\"%s\",\"bytes\":%zu,\"values\":%llu,\"iterations\":%u,"
+           "\"best_seconds\":%.6f,\"mean_seconds\":%.6f,\"mb_per_s\":%.2f,\"values_per_s\":%.0f,"
+           "\"peak_rss_kb\":%ld}\n",
+           mode->name, type->name, corpus->bytes, (unsigned long long) corpus->values, iterations,
+           best, total / iterations,
+           (double) corpus->bytes / 1e6 / best,
+           (double) corpus->values / best,
+           peak_rss_kb());
+    fflush(stdout);
+    return PwOK();
+}
+
+static bool mode_accepts(Mode* mode, CorpusType* type)
+{
+    if (mode->json != type->json) {
+        return false;
+    }
+    if (!mode->corpora) {
+        return true;
+    }
+    size_t length = strlen(type->name);
+    for (char* p = mode->corpora; (p = strstr(p, type->name)); p += length) {
+        if ((p == mode->corpora || p[-1] == ' ') && (p[length] == 0 || p[length] == ' ')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static PwResult bench_corpus(CorpusType* type, char* mode_name, size_t size, unsigned iterations)
+{
+    Corpus corpus;
+    PwValue text = PwNull();
+    PwValue status = generate_corpus(type, size, &corpus, &text);
+    pw_return_if_error(&status);
+
+    for (unsigned i = 0; i < NUM_MODES; i++) {
+        Mode* mode = &modes[i];
+        if (!mode_accepts(mode, type)) {
+            continue;
+        }
+        if (mode_name && strcmp(mode_name, mode->name) != 0) {
+            continue;
+        }
+        status = run(mode, type, &corpus, &text, iterations);
+        if (pw_error(&status)) {
+            fprintf(stderr, "%s failed on %s corpus\n", mode->name, type->name);
+            break;
+        }
+    }
+    return pw_move(&status);
+}
+
+static void usage(char* program)
+{
+    fprintf(stderr, "Usage: %s [-s size_mb] [-n iterations] [-m mode] [-c corpus]\n", program);
+    fprintf(stderr, "Modes:");
+    for (unsigned i = 0; i < NUM_MODES; i++) {
+        fprintf(stderr, " %s", modes[i].name);
+    }
+    fprintf(stderr, "\nCorpora:");
+    for (unsigned i = 0; i < NUM_CORPUS_TYPES; i++) {
+        fprintf(stderr, " %s", corpus_types[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t size = 8 << 20;
+    unsigned iterations = 5;
+    char* mode_name = nullptr;
+    char* corpus_name = nullptr;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:m:c:")) != -1) {
+        switch (opt) {
+            case 's': size = (size_t) strtoul(optarg, nullptr, 10) << 20; break;
+            case 'n': iterations = (unsigned) strtoul(optarg, nullptr, 10); break;
+            case 'm': mode_name = optarg; break;
+            case 'c': corpus_name = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc || size == 0 || iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (unsigned i = 0; i < NUM_CORPUS_TYPES; i++) {{
+        CorpusType* type = &corpus_types[i];
+        if (corpus_name && strcmp(corpus_name, type->name) != 0) {
+            continue;
+        }
+        PwValue status = bench_corpus(type, mode_name, size, iterations);
+        if (pw_error(&status)) {
+            pw_print_status(stderr, &status);
+            return 1;
+        }
+    }}
+    return 0;
+}
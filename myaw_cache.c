@@ -0,0 +1,445 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <myaw.h>
+
+#define CACHE_FILE_SUFFIX  ".mwcache"
+
+/****************************************************************
+ * SHA-256, FIPS 180-4
+ */
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, unsigned n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_transform(MwSha256* ctx, uint8_t* block)
+{
+    uint32_t w[64];
+    for (unsigned i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16)
+             | ((uint32_t) block[i * 4 + 2] << 8) | (uint32_t) block[i * 4 + 3];
+    }
+    for (unsigned i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+    for (unsigned i = 0; i < 64; i++) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+void _mw_sha256_init(MwSha256* ctx)
+{
+    static const uint32_t initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial_state, sizeof(initial_state));
+    ctx->length = 0;
+    ctx->block_len = 0;
+}
+
+void _mw_sha256_update(MwSha256* ctx, void* data, size_t size)
+{
+    uint8_t* p = data;
+    ctx->length += size;
+    while (size) {
+        size_t n = sizeof(ctx->block) - ctx->block_len;
+        if (n > size) {
+            n = size;
+        }
+        memcpy(ctx->block + ctx->block_len, p, n);
+        ctx->block_len += n;
+        p += n;
+        size -= n;
+        if (ctx->block_len == sizeof(ctx->block)) {
+            sha256_transform(ctx, ctx->block);
+            ctx->block_len = 0;
+        }
+    }
+}
+
+void _mw_sha256_final(MwSha256* ctx, char* digest)
+{
+    uint64_t bit_length = ctx->length * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t padding_len = (ctx->block_len < 56)? 56 - ctx->block_len : 120 - ctx->block_len;
+    for (unsigned i = 0; i < 8; i++) {
+        padding[padding_len + i] = (uint8_t) (bit_length >> (56 - i * 8));
+    }
+    _mw_sha256_update(ctx, padding, padding_len + 8);
+
+    static char hex_digits[] = "0123456789abcdef";
+    for (unsigned i = 0; i < 8; i++) {
+        for (unsigned j = 0; j < 8; j++) {
+            digest[i * 8 + j] = hex_digits[(ctx->state[i] >> (28 - j * 4)) & 15];
+        }
+    }
+    digest[MW_DIGEST_SIZE - 1] = 0;
+}
+
+/****************************************************************
+ * Files and cache entries
+ */
+
+static PwResult read_fd(int fd, size_t size_hint, PwValuePtr text, char* digest)
+/*
+ * Read file till the end, calculate digest of the content and decode it.
+ */
+{
+    size_t capacity = size_hint + 1;
+    size_t length = 0;
+    char* data = malloc(capacity);
+    if (!data) {
+        return PwOOM();
+    }
+    for (;;) {
+        if (length + 1 == capacity) {
+            // the file has grown
+            char* new_data = realloc(data, capacity * 2);
+            if (!new_data) {
+                free(data);
+                return PwOOM();
+            }
+            data = new_data;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + length, capacity - length - 1);
+        if (n == 0) {
+            break;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int err = errno;
+            free(data);
+            return PwErrno(err);
+        }
+        length += n;
+    }
+    data[length] = 0;
+
+    MwSha256 ctx;
+    _mw_sha256_init(&ctx);
+    _mw_sha256_update(&ctx, data, length);
+    _mw_sha256_final(&ctx, digest);
+
+    pw_destroy(text);
+    *text = _mw_create_string(data, length);
+    free(data);
+    if (pw_error(text)) {
+        return pw_clone(text);
+    }
+    return PwOK();
+}
+
+PwResult _mw_read_fd(int fd, PwValuePtr text, char* digest)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return PwErrno(errno);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return PwErrno(EINVAL);
+    }
+    return read_fd(fd, st.st_size, text, digest);
+}
+
+static void stat_source_id(char* path, struct stat* st, char* source_id)
+/*
+ * Identify source file by path, device, inode, size, and modification time.
+ */
+{
+    MwSha256 ctx;
+    _mw_sha256_init(&ctx);
+    _mw_sha256_update(&ctx, path, strlen(path) + 1);
+    _mw_sha256_update(&ctx, &st->st_dev, sizeof(st->st_dev));
+    _mw_sha256_update(&ctx, &st->st_ino, sizeof(st->st_ino));
+    _mw_sha256_update(&ctx, &st->st_size, sizeof(st->st_size));
+    _mw_sha256_update(&ctx, &st->st_mtim.tv_sec, sizeof(st->st_mtim.tv_sec));
+    _mw_sha256_update(&ctx, &st->st_mtim.tv_nsec, sizeof(st->st_mtim.tv_nsec));
+    _mw_sha256_final(&ctx, source_id);
+}
+
+static bool file_modified(struct stat* before, struct stat* after)
+{
+    return before->st_size != after->st_size
+        || before->st_mtim.tv_sec != after->st_mtim.tv_sec
+        || before->st_mtim.tv_nsec != after->st_mtim.tv_nsec;
+}
+
+static void close_fd(int* fd)
+{
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+static PwResult load_entry(char* entry_path, char* path, char* source_id, bool* found, bool* refreshed)
+/*
+ * Load cached value.
+ *
+ * Entry is a snapshot of map containing source path, source id, and value.
+ * Source path and id are checked to rule out collisions of entry names.
+ *
+ * Set `found` to false if entry does not exist or does not match.
+ * Set `refreshed` to false if modification time of the entry could not be updated.
+ */
+{
+    *found = false;
+    *refreshed = false;
+
+    [[ gnu::cleanup(mw_unload_snapshot) ]] MwSnapshot* snapshot = nullptr;
+    PwValue status = mw_load_snapshot(entry_path, &snapshot);
+    if (pw_error(&status)) {
+        return PwNull();
+    }
+    MwNode root = mw_snapshot_root(snapshot);
+    MwNode entry_source;
+    MwNode entry_id;
+    MwNode value;
+    if (!mw_node_get(root, "source", &entry_source)
+        || !mw_node_get(root, "id", &entry_id)
+        || !mw_node_get(root, "value", &value)) {
+        return PwNull();
+    }
+    char* source = mw_node_string(entry_source, nullptr);
+    char* id = mw_node_string(entry_id, nullptr);
+    if (!source || !id || strcmp(source, path) != 0 || strcmp(id, source_id) != 0) {
+        return PwNull();
+    }
+    PwValue result = mw_node_to_value(value);
+    if (pw_error(&result)) {
+        return PwNull();
+    }
+    // refresh modification time for eviction order
+    if (utimensat(AT_FDCWD, entry_path, nullptr, 0) == 0) {
+        *refreshed = true;
+    }
+    *found = true;
+    return pw_move(&result);
+}
+
+typedef struct {
+    char            name[256];
+    off_t           size;
+    struct timespec mtime;
+} CacheEntry;
+
+static int compare_entries(const void* a, const void* b)
+{
+    struct timespec* mtime_a = &((CacheEntry*) a)->mtime;
+    struct timespec* mtime_b = &((CacheEntry*) b)->mtime;
+    if (mtime_a->tv_sec != mtime_b->tv_sec) {
+        return (mtime_a->tv_sec > mtime_b->tv_sec) - (mtime_a->tv_sec < mtime_b->tv_sec);
+    }
+    return (mtime_a->tv_nsec > mtime_b->tv_nsec) - (mtime_a->tv_nsec < mtime_b->tv_nsec);
+}
+
+static void evict_entries(MwParseCache* cache)
+/*
+ * Delete least recently used entries until total size fits `max_size`
+ * and update size estimate.
+ */
+{
+    DIR* dir = opendir(cache->directory);
+    if (!dir) {
+        return;
+    }
+    CacheEntry* entries = nullptr;
+    unsigned num_entries = 0;
+    unsigned capacity = 0;
+    off_t total_size = 0;
+
+    struct dirent* d;
+    while ((d = readdir(dir))) {
+        size_t len = strlen(d->d_name);
+        size_t suffix_len = strlen(CACHE_FILE_SUFFIX);
+        if (len <= suffix_len || len >= sizeof(entries->name)
+            || strcmp(d->d_name + len - suffix_len, CACHE_FILE_SUFFIX) != 0) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), d->d_name, &st, 0) == -1) {
+            continue;
+        }
+        if (num_entries == capacity) {
+            capacity = capacity? capacity * 2 : 64;
+            CacheEntry* new_entries = realloc(entries, capacity * sizeof(CacheEntry));
+            if (!new_entries) {
+                break;
+            }
+            entries = new_entries;
+        }
+        CacheEntry* entry = &entries[num_entries++];
+        strcpy(entry->name, d->d_name);
+        entry->size = st.st_size;
+        entry->mtime = st.st_mtim;
+        total_size += st.st_size;
+    }
+
+    if ((size_t) total_size > cache->max_size) {
+        qsort(entries, num_entries, sizeof(CacheEntry), compare_entries);
+        for (unsigned i = 0; i < num_entries && (size_t) total_size > cache->max_size; i++) {
+            if (unlinkat(dirfd(dir), entries[i].name, 0) == 0) {
+                total_size -= entries[i].size;
+            }
+        }
+    }
+    __atomic_store_n(&cache->estimated_size, (size_t) total_size, __ATOMIC_RELAXED);
+    free(entries);
+    closedir(dir);
+}
+
+static PwResult store_entry(MwParseCache* cache, char* entry_path, char* path,
+                            char* source_id, PwValuePtr value)
+{
+    PwValue entry = PwMap();
+    pw_return_if_error(&entry);
+
+    PWDECL_CharPtr(source_key, "source");
+    PwValue source = pw_create_string(path);
+    pw_return_if_error(&source);
+    pw_expect_ok( pw_map_update(&entry, &source_key, &source) );
+
+    PWDECL_CharPtr(id_key, "id");
+    PwValue id = pw_create_string(source_id);
+    pw_return_if_error(&id);
+    pw_expect_ok( pw_map_update(&entry, &id_key, &id) );
+
+    PWDECL_CharPtr(value_key, "value");
+    PwValue v = pw_clone(value);
+    pw_expect_ok( pw_map_update(&entry, &value_key, &v) );
+
+    PwValue status = mw_compile_value(&entry, entry_path);
+    pw_return_if_error(&status);
+
+    if (cache->max_size) {
+        // scan the directory only when the estimate exceeds the limit,
+        // zero estimate means the size of existing entries is not known yet
+        struct stat st;
+        size_t entry_size = (stat(entry_path, &st) == 0)? (size_t) st.st_size : 0;
+        size_t estimated_size = __atomic_fetch_add(&cache->estimated_size, entry_size, __ATOMIC_RELAXED);
+        if (estimated_size == 0 || estimated_size + entry_size > cache->max_size) {
+            evict_entries(cache);
+        }
+    }
+    return PwOK();
+}
+
+PwResult mw_parse_file_cached(MwParseCache* cache, char* path)
+{
+    // non-blocking open does not hang on FIFOs
+    [[ gnu::cleanup(close_fd) ]] int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1) {
+        return PwErrno(errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return PwErrno(errno);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return PwErrno(EINVAL);
+    }
+
+    // identify the source by the same bytes that will be parsed on cache miss
+    PwValue text = PwNull();
+    char source_id[MW_DIGEST_SIZE];
+    if (cache->hash_content) {
+        PwValue status = read_fd(fd, st.st_size, &text, source_id);
+        pw_return_if_error(&status);
+    } else {
+        stat_source_id(path, &st, source_id);
+    }
+
+    // entries are named after the digest of path and source id
+    MwSha256 ctx;
+    _mw_sha256_init(&ctx);
+    _mw_sha256_update(&ctx, path, strlen(path) + 1);
+    _mw_sha256_update(&ctx, source_id, MW_DIGEST_SIZE - 1);
+    char entry_id[MW_DIGEST_SIZE];
+    _mw_sha256_final(&ctx, entry_id);
+
+    char entry_path[4096];
+    snprintf(entry_path, sizeof(entry_path), "%s/%s" CACHE_FILE_SUFFIX, cache->directory, entry_id);
+
+    bool found;
+    bool refreshed;
+    PwValue cached = load_entry(entry_path, path, source_id, &found, &refreshed);
+    if (found) {
+        if (!refreshed) {
+            // rewrite the entry so that it is not evicted as least recently used
+            PwValue store_status = store_entry(cache, entry_path, path, source_id, &cached);
+            (void) store_status;
+        }
+        return pw_move(&cached);
+    }
+
+    // cache miss, parse file
+
+    bool storable = true;
+    if (!cache->hash_content) {
+        char digest[MW_DIGEST_SIZE];
+        PwValue status = read_fd(fd, st.st_size, &text, digest);
+        pw_return_if_error(&status);
+
+        // do not store the result under stale id if the file was modified while reading
+        struct stat st_after;
+        if (fstat(fd, &st_after) == -1 || file_modified(&st, &st_after)) {
+            storable = false;
+        }
+    }
+    PwValue reader = pw_create_string_io(&text);
+    pw_return_if_error(&reader);
+
+    PwValue result = mw_parse(&reader);
+    pw_return_if_error(&result);
+
+    if (storable) {
+        // the cache is optional, failure to store entry is not an error,
+        // e.g. values of unsupported types cannot be cached
+        PwValue store_status = store_entry(cache, entry_path, path, source_id, &result);
+        (void) store_status;
+    }
+    return pw_move(&result);
+}
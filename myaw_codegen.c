@@ -0,0 +1,506 @@
+/*
+ * Generate specialized parser from schema description.
+ *
+ * Usage: myaw_codegen schema.myaw output_basename
+ *
+ * Schema is a MYAW map of structure names to maps of fields.
+ * Field value is a type, optionally followed by `required`:
+ *
+ *     tls_config:
+ *         verify: bool
+ *         ca_file: value
+ *
+ *     server_config:
+ *         host: value required
+ *         port: unsigned
+ *         tls: tls_config
+ *
+ * Supported types are bool, signed, unsigned, float, value,
+ * and names of structures defined above.
+ * Structure and field names must be C identifiers other than C and C++ keywords.
+ *
+ * The generator writes output_basename.h with structure definitions
+ * and output_basename.c with schema descriptors for mw_parse_into
+ * and typed parsers <name>_parse and <name>_parser_parse.
+ * Typed parsers match keys in place with switch statements by key length
+ * and parse booleans and numbers straight into structure members.
+ * Unlike mw_parse_into, they do not accept conversion specifiers for such fields.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <myaw.h>
+
+#define MAX_NAME_LEN  64
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    char type[MAX_NAME_LEN];
+    bool required;
+} Field;
+
+typedef struct {
+    char     name[MAX_NAME_LEN];
+    Field    fields[MW_MAX_SCHEMA_FIELDS];
+    unsigned num_fields;
+} Struct;
+
+static bool is_reserved_word(char* name)
+/*
+ * Check if `name` is a keyword of C or C++, which can include the generated header,
+ * or an identifier reserved for the implementation.
+ */
+{
+    static char* keywords[] = {
+        "alignas", "alignof", "auto", "bool", "break", "case", "char", "const", "constexpr",
+        "continue", "default", "do", "double", "else", "enum", "extern", "false", "float",
+        "for", "goto", "if", "inline", "int", "long", "nullptr", "register", "restrict",
+        "return", "short", "signed", "sizeof", "static", "static_assert", "struct", "switch",
+        "thread_local", "true", "typedef", "typeof", "typeof_unqual", "union", "unsigned",
+        "void", "volatile", "while",
+        // C++
+        "asm", "catch", "class", "const_cast", "delete", "dynamic_cast", "explicit", "export",
+        "friend", "mutable", "namespace", "new", "noexcept", "operator", "private", "protected",
+        "public", "reinterpret_cast", "static_cast", "template", "this", "throw", "try",
+        "typeid", "typename", "using", "virtual"
+    };
+    if (name[0] == '_' && (name[1] == '_' || ('A' <= name[1] && name[1] <= 'Z'))) {
+        return true;
+    }
+    for (unsigned i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (strcmp(name, keywords[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool get_identifier(PwValuePtr str, unsigned start_pos, unsigned end_pos, char* buf)
+/*
+ * Copy substring of `str` to `buf` and check it is a valid C identifier.
+ */
+{
+    if (!pw_is_string(str) || start_pos >= end_pos || end_pos - start_pos >= MAX_NAME_LEN) {
+        return false;
+    }
+    char* p = buf;
+    for (unsigned pos = start_pos; pos < end_pos; pos++) {
+        char32_t chr = pw_char_at(str, pos);
+        bool valid = chr == '_' || ('a' <= chr && chr <= 'z') || ('A' <= chr && chr <= 'Z')
+                     || (pos > start_pos && '0' <= chr && chr <= '9');
+        if (!valid) {
+            return false;
+        }
+        *p++ = (char) chr;
+    }
+    *p = 0;
+    return true;
+}
+
+static char* field_type_id(char* type)
+{
+    static char* types[][2] = {
+        { "bool",     "MW_FIELD_BOOL" },
+        { "signed",   "MW_FIELD_SIGNED" },
+        { "unsigned", "MW_FIELD_UNSIGNED" },
+        { "float",    "MW_FIELD_FLOAT" },
+        { "value",    "MW_FIELD_VALUE" }
+    };
+    for (unsigned i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (strcmp(type, types[i][0]) == 0) {
+            return types[i][1];
+        }
+    }
+    return "MW_FIELD_STRUCT";
+}
+
+static char* field_c_type(char* type)
+{
+    static char* types[][2] = {
+        { "bool",     "bool" },
+        { "signed",   "int64_t" },
+        { "unsigned", "uint64_t" },
+        { "float",    "double" },
+        { "value",    "_PwValue" }
+    };
+    for (unsigned i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (strcmp(type, types[i][0]) == 0) {
+            return types[i][1];
+        }
+    }
+    return type;
+}
+
+static bool load_struct(PwValuePtr name, PwValuePtr fields, Struct* structs, unsigned num_structs)
+{
+    Struct* s = &structs[num_structs];
+
+    if (!pw_is_string(name) || !get_identifier(name, 0, pw_strlen(name), s->name)) {
+        fprintf(stderr, "Bad structure name\n");
+        return false;
+    }
+    // reserved words include field types except `value`
+    if (is_reserved_word(s->name) || strcmp(field_type_id(s->name), "MW_FIELD_STRUCT") != 0) {
+        fprintf(stderr, "%s: reserved structure name\n", s->name);
+        return false;
+    }
+    if (!pw_is_map(fields)) {
+        fprintf(stderr, "%s: fields must be a map\n", s->name);
+        return false;
+    }
+    s->num_fields = pw_map_length(fields);
+    if (s->num_fields > MW_MAX_SCHEMA_FIELDS) {
+        fprintf(stderr, "%s: too many fields\n", s->name);
+        return false;
+    }
+    for (unsigned i = 0; i < s->num_fields; i++) {{
+        Field* f = &s->fields[i];
+        PwValue field_name = PwNull();
+        PwValue field_type = PwNull();
+        pw_map_item(fields, i, &field_name, &field_type);
+
+        if (!pw_is_string(&field_name) || !get_identifier(&field_name, 0, pw_strlen(&field_name), f->name)) {
+            fprintf(stderr, "%s: bad field name\n", s->name);
+            return false;
+        }
+        if (is_reserved_word(f->name)) {
+            fprintf(stderr, "%s.%s: reserved field name\n", s->name, f->name);
+            return false;
+        }
+        if (!pw_is_string(&field_type)) {
+            fprintf(stderr, "%s.%s: field type must be a string\n", s->name, f->name);
+            return false;
+        }
+        // field type is optionally followed by `required`
+        unsigned type_end;
+        if (!pw_strchr(&field_type, ' ', 0, &type_end)) {
+            type_end = pw_strlen(&field_type);
+        }
+        if (!get_identifier(&field_type, 0, type_end, f->type)) {
+            fprintf(stderr, "%s.%s: bad field type\n", s->name, f->name);
+            return false;
+        }
+        if (type_end < pw_strlen(&field_type)) {
+            unsigned pos = pw_string_skip_spaces(&field_type, type_end);
+            if (!pw_substring_eq(&field_type, pos, pw_strlen(&field_type), "required")) {
+                fprintf(stderr, "%s.%s: bad field attribute\n", s->name, f->name);
+                return false;
+            }
+            f->required = true;
+        }
+        if (strcmp(field_type_id(f->type), "MW_FIELD_STRUCT") == 0) {
+            // nested structures must be defined above
+            bool defined = false;
+            for (unsigned j = 0; j < num_structs; j++) {
+                if (strcmp(structs[j].name, f->type) == 0) {
+                    defined = true;
+                    break;
+                }
+            }
+            if (!defined) {
+                fprintf(stderr, "%s.%s: undefined type %s\n", s->name, f->name, f->type);
+                return false;
+            }
+        }
+    }}
+    return true;
+}
+
+static void generate_header(FILE* fp, Struct* structs, unsigned num_structs)
+{
+    fputs("#pragma once\n\n"
+          "// generated by myaw_codegen, do not edit\n\n"
+          "#include <myaw.h>\n\n"
+          "#ifdef __cplusplus\n"
+          "extern \"C\" {\n"
+          "#endif\n", fp);
+
+    for (unsigned i = 0; i < num_structs; i++) {
+        Struct* s = &structs[i];
+        fputs("\ntypedef struct {\n", fp);
+        for (unsigned j = 0; j < s->num_fields; j++) {
+            Field* f = &s->fields[j];
+            fprintf(fp, "    %s %s;\n", field_c_type(f->type), f->name);
+        }
+        fprintf(fp, "} %s;\n\n", s->name);
+        fprintf(fp, "extern MwSchema %s_schema;\n\n", s->name);
+        fprintf(fp, "void %s_init(%s* s);\n", s->name, s->name);
+        fprintf(fp, "void %s_fini(%s* s);\n", s->name, s->name);
+        fprintf(fp, "PwResult %s_parse(PwValuePtr markup, %s* out);\n", s->name, s->name);
+        fprintf(fp, "PwResult %s_parser_parse(MwParser* parser, %s* out);\n", s->name, s->name);
+    }
+
+    fputs("\n#ifdef __cplusplus\n"
+          "}\n"
+          "#endif\n", fp);
+}
+
+static void generate_match_key(FILE* fp, Struct* s)
+/*
+ * Generate lookup function that switches by key length
+ * and compares only keys of matching length.
+ */
+{
+    fprintf(fp, "\nstatic int %s_match_key(PwValuePtr str, unsigned start, unsigned end)\n{\n", s->name);
+    fputs("    switch (end - start) {\n", fp);
+
+    for (unsigned len = 1; len < MAX_NAME_LEN; len++) {
+        bool have_case = false;
+        for (unsigned j = 0; j < s->num_fields; j++) {
+            Field* f = &s->fields[j];
+            if (strlen(f->name) != len) {
+                continue;
+            }
+            if (!have_case) {
+                fprintf(fp, "        case %u:\n", len);
+                have_case = true;
+            }
+            fprintf(fp, "            if (pw_substring_eq(str, start, end, \"%s\")) { return %u; }\n", f->name, j);
+        }
+        if (have_case) {
+            fputs("            return -1;\n", fp);
+        }
+    }
+    fputs("        default:\n"
+          "            return -1;\n"
+          "    }\n"
+          "}\n", fp);
+
+    fprintf(fp, "\nstatic int %s_find_field(PwValuePtr key)\n"
+                "{\n"
+                "    if (!pw_is_string(key)) {\n"
+                "        return -1;\n"
+                "    }\n"
+                "    return %s_match_key(key, 0, pw_strlen(key));\n"
+                "}\n", s->name, s->name);
+}
+
+static void generate_parse_map(FILE* fp, Struct* s)
+/*
+ * Generate parser that matches keys in place and writes values
+ * directly to structure members, same way as mw_parse_into does.
+ */
+{
+    fprintf(fp, "\nstatic PwResult %s_parse_map(MwParser* parser, void* ptr)\n"
+                "{\n"
+                "    %s* out = ptr;\n"
+                "    uint64_t seen = 0;\n"
+                "    unsigned start_line = parser->line_number;\n"
+                "    unsigned key_indent = _mw_get_start_position(parser);\n"
+                "\n"
+                "    for (;;) {\n"
+                "        {\n"
+                "            PwValue status = _mw_count_node(parser);\n"
+                "            pw_return_if_error(&status);\n"
+                "\n"
+                "            unsigned key_start, key_end, value_pos;\n"
+                "            PwValue convspec = PwNull();\n"
+                "            status = _mw_parse_key(parser, &key_start, &key_end, &value_pos, &convspec);\n"
+                "            pw_return_if_error(&status);\n"
+                "\n"
+                "            int i = %s_match_key(&parser->current_line, key_start, key_end);\n"
+                "            if (i < 0) {\n"
+                "                return mw_parser_error(parser, key_indent, \"Unknown key\");\n"
+                "            }\n"
+                "            if (seen & (1ULL << i)) {\n"
+                "                return mw_parser_error(parser, key_indent, \"Duplicate key %%s\", %s_fields[i].name);\n"
+                "            }\n"
+                "            seen |= 1ULL << i;\n"
+                "\n"
+                "            switch (i) {\n", s->name, s->name, s->name, s->name);
+
+    for (unsigned j = 0; j < s->num_fields; j++) {
+        Field* f = &s->fields[j];
+        char* type_id = field_type_id(f->type);
+        fprintf(fp, "                case %u:\n", j);
+        if (strcmp(type_id, "MW_FIELD_STRUCT") == 0) {
+            fprintf(fp, "                    status = _mw_bind_struct(parser, value_pos, &convspec, \"%s\", "
+                        "%s_parse_map, &out->%s);\n", f->name, f->type, f->name);
+        } else if (strcmp(type_id, "MW_FIELD_VALUE") == 0) {
+            fprintf(fp, "                    status = _mw_bind_value(parser, value_pos, &convspec, &out->%s);\n",
+                    f->name);
+        } else {
+            fprintf(fp, "                    status = _mw_bind_scalar(parser, value_pos, &convspec, %s, \"%s\", "
+                        "&out->%s);\n", type_id, f->name, f->name);
+        }
+        fputs("                    break;\n", fp);
+    }
+    fputs("            }\n"
+          "            pw_return_if_error(&status);\n"
+          "        }\n"
+          "        {\n"
+          "            PwValue status = _mw_read_block_line(parser);\n"
+          "            if (_mw_end_of_block(&status)) {\n"
+          "                break;\n"
+          "            }\n"
+          "            pw_return_if_error(&status);\n"
+          "\n"
+          "            if (parser->current_indent != key_indent) {\n"
+          "                return mw_parser_error(parser, parser->current_indent, \"Bad indentation of map key\");\n"
+          "            }\n"
+          "        }\n"
+          "    }\n", fp);
+
+    for (unsigned j = 0; j < s->num_fields; j++) {
+        Field* f = &s->fields[j];
+        if (f->required) {
+            fprintf(fp, "    if (!(seen & (1ULL << %u))) {\n"
+                        "        return mw_parser_error2(parser, start_line, key_indent, \"Missing key %s\");\n"
+                        "    }\n", j, f->name);
+        }
+    }
+    fputs("    return PwOK();\n"
+          "}\n", fp);
+}
+
+static void generate_source(FILE* fp, char* header_name, Struct* structs, unsigned num_structs)
+{
+    fprintf(fp, "// generated by myaw_codegen, do not edit\n\n"
+                "#include <stddef.h>\n\n"
+                "#include \"%s\"\n", header_name);
+
+    for (unsigned i = 0; i < num_structs; i++) {
+        Struct* s = &structs[i];
+
+        generate_match_key(fp, s);
+
+        fprintf(fp, "\nstatic MwSchemaField %s_fields[] = {\n", s->name);
+        for (unsigned j = 0; j < s->num_fields; j++) {
+            Field* f = &s->fields[j];
+            char* type_id = field_type_id(f->type);
+            bool nested = strcmp(type_id, "MW_FIELD_STRUCT") == 0;
+            fprintf(fp, "    { \"%s\", offsetof(%s, %s), %s, ", f->name, s->name, f->name, type_id);
+            if (nested) {
+                fprintf(fp, "&%s_schema, ", f->type);
+            } else {
+                fputs("nullptr, ", fp);
+            }
+            fprintf(fp, "%s },\n", f->required? "true" : "false");
+        }
+        fputs("};\n", fp);
+
+        fprintf(fp, "\nMwSchema %s_schema = {\n"
+                    "    .fields = %s_fields,\n"
+                    "    .num_fields = %u,\n"
+                    "    .skip_unknown_keys = false,\n"
+                    "    .find_field = %s_find_field\n"
+                    "};\n", s->name, s->name, s->num_fields, s->name);
+
+        // init and fini
+
+        fprintf(fp, "\nvoid %s_init(%s* s)\n{\n", s->name, s->name);
+        for (unsigned j = 0; j < s->num_fields; j++) {
+            Field* f = &s->fields[j];
+            char* type_id = field_type_id(f->type);
+            if (strcmp(type_id, "MW_FIELD_STRUCT") == 0) {
+                fprintf(fp, "    %s_init(&s->%s);\n", f->type, f->name);
+            } else if (strcmp(type_id, "MW_FIELD_VALUE") == 0) {
+                fprintf(fp, "    s->%s = PwNull();\n", f->name);
+            } else {
+                fprintf(fp, "    s->%s = 0;\n", f->name);
+            }
+        }
+        fputs("}\n", fp);
+
+        fprintf(fp, "\nvoid %s_fini(%s* s)\n{\n", s->name, s->name);
+        for (unsigned j = 0; j < s->num_fields; j++) {
+            Field* f = &s->fields[j];
+            char* type_id = field_type_id(f->type);
+            if (strcmp(type_id, "MW_FIELD_STRUCT") == 0) {
+                fprintf(fp, "    %s_fini(&s->%s);\n", f->type, f->name);
+            } else if (strcmp(type_id, "MW_FIELD_VALUE") == 0) {
+                fprintf(fp, "    pw_destroy(&s->%s);\n", f->name);
+            }
+        }
+        fputs("}\n", fp);
+
+        // typed parser
+
+        generate_parse_map(fp, s);
+
+        fprintf(fp, "\nPwResult %s_parser_parse(MwParser* parser, %s* out)\n"
+                    "{\n"
+                    "    return _mw_bind_document(parser, %s_parse_map, out);\n"
+                    "}\n", s->name, s->name, s->name);
+
+        fprintf(fp, "\nPwResult %s_parse(PwValuePtr markup, %s* out)\n"
+                    "{\n"
+                    "    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);\n"
+                    "    if (!parser) {\n"
+                    "        return PwOOM();\n"
+                    "    }\n"
+                    "    return %s_parser_parse(parser, out);\n"
+                    "}\n", s->name, s->name, s->name);
+    }
+}
+
+static FILE* open_output(char* basename, char* ext, char* path, unsigned path_size)
+{
+    snprintf(path, path_size, "%s%s", basename, ext);
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+    }
+    return fp;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s schema.myaw output_basename\n", argv[0]);
+        return 1;
+    }
+
+    PWDECL_CharPtr(schema_path, argv[1]);
+    PwValue file = pw_file_open(&schema_path, O_RDONLY, 0);
+    if (pw_error(&file)) {
+        pw_print_status(stderr, &file);
+        return 1;
+    }
+    PwValue schema = mw_parse(&file);
+    if (pw_error(&schema)) {
+        pw_print_status(stderr, &schema);
+        return 1;
+    }
+    if (!pw_is_map(&schema)) {
+        fprintf(stderr, "%s: schema must be a map\n", argv[1]);
+        return 1;
+    }
+
+    static Struct structs[256];
+    unsigned num_structs = pw_map_length(&schema);
+    if (num_structs > sizeof(structs) / sizeof(structs[0])) {
+        fprintf(stderr, "%s: too many structures\n", argv[1]);
+        return 1;
+    }
+    for (unsigned i = 0; i < num_structs; i++) {{
+        PwValue name = PwNull();
+        PwValue fields = PwNull();
+        pw_map_item(&schema, i, &name, &fields);
+        if (!load_struct(&name, &fields, structs, i)) {
+            return 1;
+        }
+    }}
+
+    char header_path[4096];
+    char source_path[4096];
+
+    FILE* fp = open_output(argv[2], ".h", header_path, sizeof(header_path));
+    if (!fp) {
+        return 1;
+    }
+    generate_header(fp, structs, num_structs);
+    fclose(fp);
+
+    fp = open_output(argv[2], ".c", source_path, sizeof(source_path));
+    if (!fp) {
+        return 1;
+    }
+    char* header_name = strrchr(header_path, '/');
+    generate_source(fp, header_name? header_name + 1 : header_path, structs, num_structs);
+    fclose(fp);
+
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <myaw.h>
+
+/*
+ * Columnar extraction from lists of records.
+ *
+ * Records are parsed key by key, same way as in mw_parse_into.
+ * Values of requested keys are appended to column buffers,
+ * values of other keys are skipped by indentation.
+ */
+
+#define MIN_ROWS  1024
+
+static int find_column(MwColumn* columns, unsigned num_columns, PwValuePtr key)
+/*
+ * Return index of column that matches `key` or -1 if not found.
+ */
+{
+    if (!pw_is_string(key)) {
+        return -1;
+    }
+    unsigned key_len = pw_strlen(key);
+    for (unsigned i = 0; i < num_columns; i++) {
+        char* name = columns[i].name;
+        if (strlen(name) == key_len && pw_substring_eq(key, 0, key_len, name)) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+static bool reserve_row(MwColumn* column)
+{
+    if (column->length < column->capacity) {
+        return true;
+    }
+    unsigned capacity = column->capacity? column->capacity * 2 : MIN_ROWS;
+
+    size_t values_size;
+    switch (column->type) {
+        case MW_COLUMN_INT64:   values_size = capacity * sizeof(int64_t); break;
+        case MW_COLUMN_FLOAT64: values_size = capacity * sizeof(double); break;
+        default:                values_size = (capacity + 1) * sizeof(size_t); break;
+    }
+    void* values = realloc(column->values, values_size);
+    if (!values) {
+        return false;
+    }
+    column->values = values;
+    if (column->capacity == 0 && column->type == MW_COLUMN_STRING) {
+        column->string_offsets[0] = 0;
+    }
+
+    size_t old_bitmap_size = (column->capacity + 7) / 8;
+    size_t new_bitmap_size = (capacity + 7) / 8;
+    uint8_t* nulls = realloc(column->nulls, new_bitmap_size);
+    if (!nulls) {
+        return false;
+    }
+    memset(nulls + old_bitmap_size, 0, new_bitmap_size - old_bitmap_size);
+    column->nulls = nulls;
+
+    column->capacity = capacity;
+    return true;
+}
+
+static PwResult append_null(MwColumn* column)
+{
+    if (!reserve_row(column)) {
+        return PwOOM();
+    }
+    unsigned row = column->length++;
+    column->nulls[row >> 3] |= 1 << (row & 7);
+    switch (column->type) {
+        case MW_COLUMN_INT64:
+            column->int64_values[row] = 0;
+            break;
+        case MW_COLUMN_FLOAT64:
+            column->float64_values[row] = 0.0;
+            break;
+        case MW_COLUMN_STRING:
+            column->string_offsets[row + 1] = column->string_offsets[row];
+            break;
+    }
+    return PwOK();
+}
+
+static PwResult append_string(MwColumn* column, PwValuePtr str)
+{
+    unsigned length = pw_strlen(str);
+    for (unsigned i = 0; i < length; i++) {{
+        PwValue status = _mw_sink_write_char(&column->arena, pw_char_at(str, i));
+        pw_return_if_error(&status);
+    }}
+    unsigned row = column->length++;
+    column->string_offsets[row + 1] = column->arena.length;
+    return PwOK();
+}
+
+static PwResult append_value(MwParser* parser, MwColumn* column, PwValuePtr value,
+                             unsigned line_number, unsigned position)
+/*
+ * Convert `value` to the type of `column` and append it.
+ */
+{
+    if (pw_is_null(value)) {
+        return append_null(column);
+    }
+    if (!reserve_row(column)) {
+        return PwOOM();
+    }
+    unsigned row = column->length;
+    switch (column->type) {
+        case MW_COLUMN_INT64:
+            if (pw_is_signed(value)) {
+                column->int64_values[row] = value->signed_value;
+                column->length++;
+                return PwOK();
+            }
+            if (pw_is_unsigned(value) && value->unsigned_value <= INT64_MAX) {
+                column->int64_values[row] = (int64_t) value->unsigned_value;
+                column->length++;
+                return PwOK();
+            }
+            break;
+
+        case MW_COLUMN_FLOAT64:
+            if (pw_is_float(value)) {
+                column->float64_values[row] = value->float_value;
+                column->length++;
+                return PwOK();
+            }
+            if (pw_is_signed(value)) {
+                column->float64_values[row] = (double) value->signed_value;
+                column->length++;
+                return PwOK();
+            }
+            if (pw_is_unsigned(value)) {
+                column->float64_values[row] = (double) value->unsigned_value;
+                column->length++;
+                return PwOK();
+            }
+            break;
+
+        case MW_COLUMN_STRING:
+            if (pw_is_string(value)) {
+                return append_string(column, value);
+            }
+            break;
+    }
+    return mw_parser_error2(parser, line_number, position, "Bad type of value for %s", column->name);
+}
+
+static PwResult parse_column_value(MwParser* parser, MwColumn* column,
+                                   unsigned value_pos, PwValuePtr convspec)
+/*
+ * Parse value as a nested block starting from `value_pos`, similar to parse_map.
+ */
+{
+    unsigned saved_block_indent;
+    PwValue status = PwNull();
+    if (_mw_comment_or_end_of_line(parser, value_pos)) {
+        status = _mw_start_nested_block_from_next_line(parser, &saved_block_indent);
+    } else {
+        status = _mw_start_nested_block(parser, value_pos, &saved_block_indent);
+    }
+    pw_return_if_error(&status);
+
+    unsigned line_number = parser->line_number;
+    unsigned position = _mw_get_start_position(parser);
+
+    PwValue result = PwNull();
+    PwValue value = PwNull();
+    if (pw_is_string(convspec)) {
+        MwBlockParserFunc parser_func = _mw_get_custom_parser(parser, convspec);
+        value = parser_func(parser);
+    } else {
+        value = _mw_parse_value(parser, nullptr, nullptr);
+    }
+    if (pw_error(&value)) {
+        result = pw_move(&value);
+    } else {
+        result = append_value(parser, column, &value, line_number, position);
+    }
+    _mw_end_nested_block(parser, saved_block_indent);
+    return pw_move(&result);
+}
+
+static PwResult parse_record(MwParser* parser, MwColumn* columns, unsigned num_columns)
+/*
+ * Parse map starting from the current block position and append one row to all columns.
+ */
+{
+    uint64_t seen = 0;
+
+    // all keys in the map must have the same indent
+    unsigned key_indent = _mw_get_start_position(parser);
+
+    for (;;) {
+        {
+            PwValue status = _mw_count_node(parser);
+            pw_return_if_error(&status);
+
+            unsigned value_pos;
+            PwValue convspec = PwNull();
+            PwValue key = _mw_parse_value(parser, &value_pos, &convspec);
+            pw_return_if_error(&key);
+
+            int i = find_column(columns, num_columns, &key);
+            if (i < 0) {
+                PwValue status = _mw_skip_value(parser, key_indent);
+                pw_return_if_error(&status);
+            } else {
+                uint64_t mask = 1ULL << i;
+                if (seen & mask) {
+                    return mw_parser_error(parser, key_indent, "Duplicate key %s", columns[i].name);
+                }
+                seen |= mask;
+
+                PwValue status = parse_column_value(parser, &columns[i], value_pos, &convspec);
+                pw_return_if_error(&status);
+            }
+        }
+        {
+            PwValue status = _mw_read_block_line(parser);
+            if (_mw_end_of_block(&status)) {
+                break;
+            }
+            pw_return_if_error(&status);
+
+            if (parser->current_indent != key_indent) {
+                return mw_parser_error(parser, parser->current_indent, "Bad indentation of map key");
+            }
+        }
+    }
+
+    // missing keys are nulls
+    for (unsigned i = 0; i < num_columns; i++) {{
+        if (!(seen & (1ULL << i))) {
+            PwValue status = append_null(&columns[i]);
+            pw_return_if_error(&status);
+        }
+    }}
+    return PwOK();
+}
+
+static bool is_list_item(MwParser* parser, unsigned item_indent)
+/*
+ * Check if line at `item_indent` starts with hyphen followed by space or end of line.
+ */
+{
+    PwValuePtr current_line = &parser->current_line;
+    if (!pw_string_index_valid(current_line, item_indent)
+        || pw_char_at(current_line, item_indent) != '-') {
+        return false;
+    }
+    if (!pw_string_index_valid(current_line, item_indent + 1)) {
+        return true;
+    }
+    char32_t chr = pw_char_at(current_line, item_indent + 1);
+    return chr == ' ' || chr == '\t';
+}
+
+static PwResult parse_records(MwParser* parser, MwColumn* columns, unsigned num_columns)
+/*
+ * Parse list of records starting from the current block position.
+ */
+{
+    if (num_columns > MW_MAX_COLUMNS) {
+        return mw_parser_error(parser, parser->current_indent, "Too many columns");
+    }
+
+    // all list items must have the same indent
+    unsigned item_indent = _mw_get_start_position(parser);
+
+    for (;;) {
+        {
+            if (!is_list_item(parser, item_indent)) {
+                return mw_parser_error(parser, item_indent, "List of records expected");
+            }
+            PwValue status = _mw_count_node(parser);
+            pw_return_if_error(&status);
+
+            // parse record as a nested block
+            unsigned next_pos = item_indent + 1;
+            unsigned saved_block_indent;
+            if (_mw_comment_or_end_of_line(parser, next_pos)) {
+                status = _mw_start_nested_block_from_next_line(parser, &saved_block_indent);
+            } else {
+                status = _mw_start_nested_block(parser, next_pos + 1, &saved_block_indent);
+            }
+            pw_return_if_error(&status);
+
+            status = parse_record(parser, columns, num_columns);
+            _mw_end_nested_block(parser, saved_block_indent);
+            pw_return_if_error(&status);
+        }
+        {
+            PwValue status = _mw_read_block_line(parser);
+            if (_mw_end_of_block(&status)) {
+                break;
+            }
+            pw_return_if_error(&status);
+
+            if (parser->current_indent != item_indent) {
+                return mw_parser_error(parser, parser->current_indent, "Bad indentation of list item");
+            }
+        }
+    }
+    return PwOK();
+}
+
+static void clear_columns(MwColumn* columns, unsigned num_columns)
+/*
+ * Initialize columns so they can be freed with mw_column_fini.
+ */
+{
+    for (unsigned i = 0; i < num_columns; i++) {
+        MwColumn* column = &columns[i];
+        column->length = 0;
+        column->capacity = 0;
+        column->values = nullptr;
+        column->nulls = nullptr;
+        column->arena = (MwSink) { .fd = -1 };
+    }
+}
+
+PwResult mw_extract_columns(PwValuePtr markup, MwColumn* columns, unsigned num_columns)
+{
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
+    if (!parser) {
+        clear_columns(columns, num_columns);
+        return PwOOM();
+    }
+    return mw_parser_extract_columns(parser, columns, num_columns);
+}
+
+PwResult mw_parser_extract_columns(MwParser* parser, MwColumn* columns, unsigned num_columns)
+{
+    clear_columns(columns, num_columns);
+    for (unsigned i = 0; i < num_columns; i++) {{
+        if (columns[i].type == MW_COLUMN_STRING) {
+            PwValue status = mw_sink_init(&columns[i].arena, -1, 0);
+            pw_return_if_error(&status);
+        }
+    }}
+
+    // read first line to prepare for parsing and to detect EOF
+    PwValue status = _mw_read_block_line(parser);
+    if (_mw_end_of_block(&status) && parser->eof) {
+        return PwStatus(PW_ERROR_EOF);
+    }
+    pw_return_if_error(&status);
+
+    status = parse_records(parser, columns, num_columns);
+    pw_return_if_error(&status);
+
+    // make sure markup has no more data
+    status = _mw_read_block_line(parser);
+    if (parser->eof) {
+        // all right, no op
+    } else {
+        pw_return_if_error(&status);
+        return mw_parser_error(parser, parser->current_indent, "Extra data after parsed value");
+    }
+    return PwOK();
+}
+
+void mw_column_fini(MwColumn* column)
+{
+    free(column->values);
+    free(column->nulls);
+    column->values = nullptr;
+    column->nulls = nullptr;
+    column->length = 0;
+    column->capacity = 0;
+    mw_sink_fini(&column->arena);
+}
@@ -0,0 +1,307 @@
+#include <string.h>
+
+#include <myaw.h>
+
+/*
+ * MYAW emitter.
+ *
+ * Strings are written in the simplest form that parses back to the same value:
+ * single-line literal, literal block with :literal: conversion specifier,
+ * or single-line quoted string with escapes.
+ * Empty lists and maps are written as JSON.
+ * Packed arrays are written with :int64[]: or :float64[]: conversion specifier.
+ */
+
+#define DEFAULT_INDENT  4
+
+// number of packed array items per line
+#define PACKED_ITEMS_PER_LINE  8
+
+typedef enum {
+    FORM_LITERAL,
+    FORM_LITERAL_BLOCK,
+    FORM_QUOTED
+} StringForm;
+
+typedef struct {
+    MwSink*  sink;
+    unsigned indent;
+    bool     quote_strings;
+} Dumper;
+
+static inline PwResult write_cstr(Dumper* dumper, char* str)
+{
+    return mw_sink_write(dumper->sink, str, strlen(str));
+}
+
+static PwResult write_spaces(Dumper* dumper, unsigned n)
+{
+    char* p;
+    PwValue status = _mw_sink_reserve(dumper->sink, n, &p);
+    pw_return_if_error(&status);
+
+    memset(p, ' ', n);
+    dumper->sink->length += n;
+    return PwOK();
+}
+
+static PwResult write_chars(Dumper* dumper, PwValuePtr str, unsigned start_pos, unsigned end_pos)
+{
+    for (unsigned i = start_pos; i < end_pos; i++) {{
+        PwValue status = _mw_sink_write_char(dumper->sink, pw_char_at(str, i));
+        pw_return_if_error(&status);
+    }}
+    return PwOK();
+}
+
+static StringForm string_form(Dumper* dumper, PwValuePtr str, bool is_key)
+{
+    unsigned length = pw_strlen(str);
+    if (length == 0 || dumper->quote_strings) {
+        return FORM_QUOTED;
+    }
+    char32_t first_chr = pw_char_at(str, 0);
+    if (first_chr == ' ' || first_chr == '#' || first_chr == '\n') {
+        return FORM_QUOTED;
+    }
+
+    bool has_special = false;  // characters that may look like syntax in single-line literal
+    unsigned num_lines = 0;
+    char32_t prev_chr = 0;
+    for (unsigned i = 0; i < length; i++) {
+        char32_t chr = pw_char_at(str, i);
+        if (chr == '\n') {
+            if (prev_chr == ' ') {
+                // trailing spaces are stripped by line reader
+                return FORM_QUOTED;
+            }
+            num_lines++;
+        } else if (chr < 0x20 || chr == 0x7F) {
+            return FORM_QUOTED;
+        } else if (chr == ':' || chr == '#') {
+            has_special = true;
+        }
+        prev_chr = chr;
+    }
+
+    if (num_lines == 0) {
+        if (has_special || prev_chr == ' ') {
+            return FORM_QUOTED;
+        }
+        // type deduction rules
+        if (first_chr == '-' || first_chr == '+' || first_chr == '"' || first_chr == '\''
+            || first_chr == ':' || ('0' <= first_chr && first_chr <= '9')) {
+            return FORM_QUOTED;
+        }
+        if (pw_substring_eq(str, 0, 4, "null")
+            || pw_substring_eq(str, 0, 4, "true")
+            || pw_substring_eq(str, 0, 5, "false")) {
+            return FORM_QUOTED;
+        }
+        return FORM_LITERAL;
+    }
+
+    // literal blocks end with single line break, have more than one line,
+    // and the first line is not indented so that dedent keeps the text intact
+    if (is_key || prev_chr != '\n' || num_lines < 2) {
+        return FORM_QUOTED;
+    }
+    if (pw_char_at(str, length - 2) == '\n') {
+        // trailing empty lines are dropped
+        return FORM_QUOTED;
+    }
+    return FORM_LITERAL_BLOCK;
+}
+
+static PwResult write_scalar(Dumper* dumper, PwValuePtr value, bool is_key)
+/*
+ * Write single-line value without line break.
+ */
+{
+    if (pw_is_null(value)) {
+        return write_cstr(dumper, "null");
+    }
+    if (pw_is_bool(value)) {
+        return write_cstr(dumper, value->bool_value? "true" : "false");
+    }
+    if (pw_is_string(value)) {
+        if (string_form(dumper, value, is_key) == FORM_LITERAL) {
+            return write_chars(dumper, value, 0, pw_strlen(value));
+        }
+        return _mw_sink_write_quoted(dumper->sink, value);
+    }
+
+    // date/time and timestamp values are not supported, same as for snapshots
+    return _mw_sink_write_number(dumper->sink, value);
+}
+
+static inline bool is_block_value(Dumper* dumper, PwValuePtr value)
+/*
+ * Return true if value is written starting from a new line when it is a map value.
+ */
+{
+    if (pw_is_array(value)) {
+        return pw_array_length(value) != 0;
+    }
+    if (pw_is_map(value)) {
+        return pw_map_length(value) != 0;
+    }
+    return false;
+}
+
+static PwResult dump_value(Dumper* dumper, PwValuePtr value, unsigned indent);
+
+static PwResult dump_literal_block(Dumper* dumper, PwValuePtr str, unsigned indent)
+{
+    PwValue status = write_cstr(dumper, ":literal:\n");
+    pw_return_if_error(&status);
+
+    unsigned length = pw_strlen(str);
+    unsigned line_start = 0;
+    for (unsigned pos = 0; pos < length; pos++) {
+        if (pw_char_at(str, pos) != '\n') {
+            continue;
+        }
+        if (pos > line_start) {
+            status = write_spaces(dumper, indent);
+            pw_return_if_error(&status);
+            status = write_chars(dumper, str, line_start, pos);
+            pw_return_if_error(&status);
+        }
+        status = mw_sink_write(dumper->sink, "\n", 1);
+        pw_return_if_error(&status);
+        line_start = pos + 1;
+    }
+    return PwOK();
+}
+
+static PwResult dump_packed_array(Dumper* dumper, PwValuePtr array, unsigned indent)
+{
+    PwValue status = write_cstr(dumper, (mw_packed_type(array) == MW_PACKED_INT64)? ":int64[]:\n" : ":float64[]:\n");
+    pw_return_if_error(&status);
+
+    unsigned length = mw_packed_length(array);
+    for (unsigned i = 0; i < length; i++) {{
+        if (i % PACKED_ITEMS_PER_LINE == 0) {
+            status = write_spaces(dumper, indent);
+        } else {
+            status = write_cstr(dumper, ", ");
+        }
+        pw_return_if_error(&status);
+
+        PwValue item = mw_packed_item(array, i);
+        status = _mw_sink_write_number(dumper->sink, &item);
+        pw_return_if_error(&status);
+
+        if (i % PACKED_ITEMS_PER_LINE == PACKED_ITEMS_PER_LINE - 1 || i == length - 1) {
+            status = mw_sink_write(dumper->sink, "\n", 1);
+            pw_return_if_error(&status);
+        }
+    }}
+    return PwOK();
+}
+
+static PwResult dump_list(Dumper* dumper, PwValuePtr list, unsigned indent)
+{
+    unsigned length = pw_array_length(list);
+    for (unsigned i = 0; i < length; i++) {{
+        if (i) {
+            PwValue status = write_spaces(dumper, indent);
+            pw_return_if_error(&status);
+        }
+        PwValue status = write_cstr(dumper, "- ");
+        pw_return_if_error(&status);
+
+        // item is a nested block that starts on the same line
+        PwValue item = pw_array_item(list, i);
+        status = dump_value(dumper, &item, indent + 2);
+        pw_return_if_error(&status);
+    }}
+    return PwOK();
+}
+
+static PwResult dump_map(Dumper* dumper, PwValuePtr map, unsigned indent)
+{
+    unsigned value_indent = indent + dumper->indent;
+    unsigned length = pw_map_length(map);
+    for (unsigned i = 0; i < length; i++) {{
+        if (i) {
+            PwValue status = write_spaces(dumper, indent);
+            pw_return_if_error(&status);
+        }
+        PwValue key = PwNull();
+        PwValue value = PwNull();
+        pw_map_item(map, i, &key, &value);
+
+        if (pw_is_array(&key) || pw_is_map(&key) || mw_is_packed_array(&key)) {
+            return PwError(MW_UNSUPPORTED_TYPE);
+        }
+        PwValue status = write_scalar(dumper, &key, true);
+        pw_return_if_error(&status);
+
+        if (is_block_value(dumper, &value)) {
+            status = write_cstr(dumper, ":\n");
+            pw_return_if_error(&status);
+            status = write_spaces(dumper, value_indent);
+            pw_return_if_error(&status);
+        } else {
+            status = write_cstr(dumper, ": ");
+            pw_return_if_error(&status);
+        }
+        status = dump_value(dumper, &value, value_indent);
+        pw_return_if_error(&status);
+    }}
+    return PwOK();
+}
+
+static PwResult dump_value(Dumper* dumper, PwValuePtr value, unsigned indent)
+/*
+ * Write value starting from the current position and terminate it with line break.
+ * `indent` is the block indent for subsequent lines of the value.
+ */
+{
+    if (pw_is_array(value)) {
+        if (pw_array_length(value) == 0) {
+            return write_cstr(dumper, ":json: []\n");
+        }
+        return dump_list(dumper, value, indent);
+    }
+    if (pw_is_map(value)) {
+        if (pw_map_length(value) == 0) {
+            return write_cstr(dumper, ":json: {}\n");
+        }
+        return dump_map(dumper, value, indent);
+    }
+    if (mw_is_packed_array(value)) {
+        if (mw_packed_length(value) == 0) {
+            // empty block is not allowed
+            return write_cstr(dumper, ":json: []\n");
+        }
+        return dump_packed_array(dumper, value, indent);
+    }
+    if (pw_is_string(value) && string_form(dumper, value, false) == FORM_LITERAL_BLOCK) {
+        return dump_literal_block(dumper, value, indent);
+    }
+    PwValue status = write_scalar(dumper, value, false);
+    pw_return_if_error(&status);
+
+    return mw_sink_write(dumper->sink, "\n", 1);
+}
+
+PwResult mw_dump(PwValuePtr value, MwSink* sink, MwDumpOptions* options)
+{
+    Dumper dumper = {
+        .sink = sink,
+        .indent = DEFAULT_INDENT
+    };
+    if (options) {
+        if (options->indent) {
+            dumper.indent = options->indent;
+        }
+        dumper.quote_strings = options->quote_strings;
+    }
+    PwValue status = dump_value(&dumper, value, 0);
+    pw_return_if_error(&status);
+
+    return mw_sink_flush(sink);
+}
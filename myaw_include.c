@@ -0,0 +1,334 @@
+// for O_PATH
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/openat2.h>
+
+#include <myaw.h>
+
+/*
+ * :include: conversion specifier.
+ *
+ * The specifier is disabled by default and is enabled by mw_enable_include,
+ * which confines included files to a directory.
+ *
+ * Included files are parsed by nested parsers that share the cache
+ * of the including parser. Cached values are returned by reference,
+ * so repeated includes cost neither parsing nor copying.
+ * Cache entries are keyed by canonical path and checked against content hash
+ * of the same bytes that are parsed.
+ *
+ * Paths are checked after canonicalization, but files are opened relative
+ * to include directory without leaving it, so that a path component replaced
+ * with a symbolic link after the check cannot redirect the include outside.
+ */
+
+PwResult mw_enable_include(MwParser* parser, char* include_dir)
+{
+    parser->include_dir = include_dir;
+    return mw_set_custom_parser(parser, "include", _mw_include_parser_func);
+}
+
+static PwResult path_to_cstr(PwValuePtr path, char* buffer, size_t size)
+/*
+ * Encode `path` as UTF-8 into `buffer`.
+ */
+{
+    MwSink sink;
+    PwValue status = mw_sink_init(&sink, -1, PATH_MAX);
+    pw_return_if_error(&status);
+
+    unsigned length = pw_strlen(path);
+    for (unsigned i = 0; i < length; i++) {
+        status = _mw_sink_write_char(&sink, pw_char_at(path, i));
+        if (pw_error(&status)) {
+            mw_sink_fini(&sink);
+            return pw_move(&status);
+        }
+    }
+    if (sink.length >= size) {
+        mw_sink_fini(&sink);
+        return PwErrno(ENAMETOOLONG);
+    }
+    memcpy(buffer, sink.data, sink.length);
+    buffer[sink.length] = 0;
+    mw_sink_fini(&sink);
+    return PwOK();
+}
+
+static char* get_base_dir(MwParser* parser, char* buffer)
+/*
+ * Return directory of the file being parsed or include_dir.
+ */
+{
+    if (parser->include_frame) {
+        strcpy(buffer, parser->include_frame->path);
+        return dirname(buffer);
+    }
+    return parser->include_dir;
+}
+
+static PwResult parse_text(MwParser* parser, PwValuePtr text, char* path, unsigned depth)
+/*
+ * Parse content of included file with nested parser that inherits settings of `parser`.
+ */
+{
+    PwValue reader = pw_create_string_io(text);
+    pw_return_if_error(&reader);
+
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* nested = mw_create_parser(&reader);
+    if (!nested) {
+        return PwOOM();
+    }
+    pw_destroy(&nested->custom_parsers);
+    nested->custom_parsers = pw_clone(&parser->custom_parsers);
+    pw_destroy(&nested->convspecs_with_arg);
+    nested->convspecs_with_arg = pw_clone(&parser->convspecs_with_arg);
+    nested->max_blocklevel = parser->max_blocklevel;
+    nested->max_json_depth = parser->max_json_depth;
+    nested->validate_only = parser->validate_only;
+    nested->pack_json_arrays = parser->pack_json_arrays;
+    nested->include_dir = parser->include_dir;
+
+    // limits apply to the whole document, including included files
+    nested->limits = parser->limits;
+    nested->deadline = parser->deadline;
+    nested->input_size = parser->input_size;
+    nested->num_nodes = parser->num_nodes;
+    nested->alloc_size = parser->alloc_size;
+
+    MwIncludeFrame frame = {
+        .path   = path,
+        .depth  = depth,
+        .parent = parser->include_frame
+    };
+    nested->include_frame = &frame;
+
+    // lend the cache to nested parser
+    nested->include_cache = pw_move(&parser->include_cache);
+
+    PwValue result = mw_parser_parse(nested);
+
+    parser->include_cache = pw_move(&nested->include_cache);
+
+    parser->input_size = nested->input_size;
+    parser->num_nodes = nested->num_nodes;
+    parser->alloc_size = nested->alloc_size;
+    return pw_move(&result);
+}
+
+static void close_fd(int* fd)
+{
+    if (*fd != -1) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+static int walk_beneath(int root_fd, char* relative_path, int flags)
+/*
+ * Open `relative_path` component by component without following symbolic links,
+ * for kernels without openat2. Canonical paths contain neither links nor dot-dot.
+ */
+{
+    char buffer[PATH_MAX];
+    strcpy(buffer, relative_path);
+
+    int dir_fd = root_fd;
+    char* component = buffer;
+    for (;;) {
+        char* slash = strchr(component, '/');
+        if (!slash) {
+            break;
+        }
+        *slash = 0;
+        int fd = openat(dir_fd, component, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        int err = errno;
+        if (dir_fd != root_fd) {
+            close(dir_fd);
+        }
+        if (fd == -1) {
+            errno = err;
+            return -1;
+        }
+        dir_fd = fd;
+        component = slash + 1;
+    }
+    int fd = openat(dir_fd, component, flags | O_NOFOLLOW);
+    int err = errno;
+    if (dir_fd != root_fd) {
+        close(dir_fd);
+    }
+    errno = err;
+    return fd;
+}
+
+static int open_beneath(char* root, char* relative_path)
+/*
+ * Open file at `relative_path` which must not resolve outside of `root`.
+ * Return file descriptor or -1 with errno set.
+ */
+{
+    [[ gnu::cleanup(close_fd) ]] int root_fd = open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd == -1) {
+        return -1;
+    }
+    // non-blocking open does not hang on FIFOs
+    int flags = O_RDONLY | O_CLOEXEC | O_NONBLOCK;
+    struct open_how how = {
+        .flags   = flags,
+        .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS
+    };
+    int fd = (int) syscall(SYS_openat2, root_fd, relative_path, &how, sizeof(how));
+    if (fd == -1 && errno == ENOSYS) {
+        fd = walk_beneath(root_fd, relative_path, flags);
+    }
+    return fd;
+}
+
+static PwResult include_file(MwParser* parser, int fd, char* canonical_path, char* include_path,
+                             unsigned depth, unsigned line_number, unsigned position)
+{
+    // the digest is calculated from the bytes that are parsed,
+    // so a file rewritten meanwhile cannot be cached under stale digest
+    char digest[MW_DIGEST_SIZE];
+    PwValue text = PwNull();
+    PwValue status = _mw_read_fd(fd, &text, digest);
+    if (pw_error(&status)) {
+        return mw_parser_error2(parser, line_number, position, "Cannot read %s", include_path);
+    }
+
+    if (pw_is_null(&parser->include_cache)) {
+        parser->include_cache = PwMap();
+        pw_return_if_error(&parser->include_cache);
+    }
+    PwValue key = pw_create_string(canonical_path);
+    pw_return_if_error(&key);
+
+    PwValue entry = pw_map_get(&parser->include_cache, &key);
+    if (pw_is_array(&entry)) {
+        PwValue cached_digest = pw_array_item(&entry, 0);
+        if (pw_substring_eq(&cached_digest, 0, MW_DIGEST_SIZE - 1, digest)) {
+            // shared reference to cached value
+            return pw_array_item(&entry, 1);
+        }
+    }
+
+    PwValue value = parse_text(parser, &text, canonical_path, depth);
+    pw_return_if_error(&value);
+
+    PwValue new_entry = PwArray();
+    pw_return_if_error(&new_entry);
+
+    PwValue digest_value = pw_create_string(digest);
+    pw_return_if_error(&digest_value);
+    pw_expect_ok( pw_array_append(&new_entry, &digest_value) );
+    pw_expect_ok( pw_array_append(&new_entry, &value) );
+    pw_expect_ok( pw_map_update(&parser->include_cache, &key, &new_entry) );
+
+    return pw_move(&value);
+}
+
+static bool inside_dir(char* path, char* dir)
+/*
+ * Check if canonical `path` is located inside canonical `dir`.
+ */
+{
+    size_t len = strlen(dir);
+    if (len == 1 && dir[0] == '/') {
+        return true;
+    }
+    return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+PwResult _mw_include_parser_func(MwParser* parser)
+/*
+ * The block contains path of file to include, relative to the directory
+ * of the including file, optionally followed by comment.
+ */
+{
+    unsigned line_number = parser->line_number;
+    unsigned start_pos = _mw_get_start_position(parser);
+
+    if (!parser->include_dir) {
+        return mw_parser_error2(parser, line_number, start_pos, "Include is not enabled");
+    }
+
+    PwValue path = pw_substr(&parser->current_line, start_pos, _mw_value_end(&parser->current_line, start_pos));
+    pw_return_if_error(&path);
+
+    // make sure current block has no more data
+    PwValue status = _mw_read_block_line(parser);
+    if (!_mw_end_of_block(&status)) {
+        pw_return_if_error(&status);
+        return mw_parser_error(parser, parser->current_indent, "Include path must be a single line");
+    }
+
+    char include_path[PATH_MAX];
+    status = path_to_cstr(&path, include_path, sizeof(include_path));
+    pw_return_if_error(&status);
+
+    if (include_path[0] == '/') {
+        return mw_parser_error2(parser, line_number, start_pos, "Include path must be relative");
+    }
+
+    char full_path[PATH_MAX];
+    char base_dir_buffer[PATH_MAX];
+    char* base_dir = get_base_dir(parser, base_dir_buffer);
+    int n = snprintf(full_path, sizeof(full_path), "%s/%s", base_dir, include_path);
+    if (n < 0 || (size_t) n >= sizeof(full_path)) {
+        return mw_parser_error2(parser, line_number, start_pos, "Include path is too long");
+    }
+
+    // paths are not disclosed in errors, they may point to anything
+    char include_root[PATH_MAX];
+    char canonical_path[PATH_MAX];
+    if (!realpath(parser->include_dir, include_root)) {
+        return mw_parser_error2(parser, line_number, start_pos, "Bad include directory");
+    }
+    if (!realpath(full_path, canonical_path)) {
+        return mw_parser_error2(parser, line_number, start_pos, "Cannot include %s: %s",
+                                include_path, strerror(errno));
+    }
+    if (!inside_dir(canonical_path, include_root)) {
+        return mw_parser_error2(parser, line_number, start_pos, "Include path is outside of include directory");
+    }
+    char* relative_path = canonical_path + strlen(include_root);
+    while (*relative_path == '/') {
+        relative_path++;
+    }
+    [[ gnu::cleanup(close_fd) ]] int fd = open_beneath(include_root, relative_path);
+    if (fd == -1) {
+        return mw_parser_error2(parser, line_number, start_pos, "Cannot include %s: %s",
+                                include_path, strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return mw_parser_error2(parser, line_number, start_pos, "Not a regular file: %s", include_path);
+    }
+
+    // check limits
+    unsigned depth = 1;
+    for (MwIncludeFrame* frame = parser->include_frame; frame; frame = frame->parent) {
+        if (strcmp(frame->path, canonical_path) == 0) {
+            return mw_parser_error2(parser, line_number, start_pos, "Include cycle: %s", include_path);
+        }
+    }
+    if (parser->include_frame) {
+        depth = parser->include_frame->depth + 1;
+    }
+    if (depth > MW_MAX_INCLUDE_DEPTH) {
+        return mw_parser_error2(parser, line_number, start_pos, "Too many nested includes");
+    }
+    return include_file(parser, fd, canonical_path, include_path, depth, line_number, start_pos);
+}
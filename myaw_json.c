@@ -3,6 +3,69 @@
 
 static char32_t number_terminators[] = { MW_COMMENT, ':', ',', '}', ']', 0 };
 
+// maximal number of characters scanned by count_items
+#define LOOKAHEAD_LIMIT  1024
+
+/*
+ * Long lines can be read in parts, see mw_parser_parse_json.
+ * Then current_line is a sliding window: skip_spaces drops parsed characters
+ * and reads the next part, and strings, numbers, and literals extend the window
+ * till their end. Positions are valid only till the next call that takes them
+ * by pointer, which is how they are passed around anyway.
+ */
+
+static PwResult skip_line_rest(MwParser* parser)
+/*
+ * Drop the rest of the current line, e.g. comment, in all parts.
+ */
+{
+    while (parser->line_continues) {
+        unsigned pos = pw_strlen(&parser->current_line);
+        PwValue status = _mw_read_line_part(parser, &pos);
+        pw_return_if_error(&status);
+    }
+    return PwOK();
+}
+
+static PwResult extend_window(MwParser* parser, unsigned* pos, unsigned min_length)
+/*
+ * Make sure the window has at least `min_length` characters starting from `pos`,
+ * unless the line ends earlier.
+ */
+{
+    while (parser->line_continues && pw_strlen(&parser->current_line) - *pos < min_length) {
+        PwValue status = _mw_read_line_part(parser, pos);
+        pw_return_if_error(&status);
+    }
+    return PwOK();
+}
+
+static inline bool is_number_char(char32_t chr)
+{
+    return !(pw_isspace(chr) || chr == MW_COMMENT || chr == ':' || chr == ',' || chr == '}' || chr == ']');
+}
+
+static PwResult extend_window_to_number_end(MwParser* parser, unsigned* pos)
+/*
+ * Make sure the number starting from `pos` ends within the window.
+ */
+{
+    unsigned end = *pos;
+    for (;;) {
+        unsigned length = pw_strlen(&parser->current_line);
+        while (end < length && is_number_char(pw_char_at(&parser->current_line, end))) {
+            end++;
+        }
+        if (end < length || !parser->line_continues) {
+            return PwOK();
+        }
+        unsigned start = *pos;
+        PwValue status = _mw_read_line_part(parser, pos);
+        pw_return_if_error(&status);
+        end -= start;
+    }
+}
+
 
 static PwResult skip_spaces(MwParser* parser, unsigned* pos, unsigned source_line)
 /*
@@ -25,6 +88,14 @@ static PwResult skip_spaces(MwParser* parser, unsigned* pos, unsigned source_lin
             if (chr != '#') {
                 return PwUnsigned(chr);
             }
+            PwValue status = skip_line_rest(parser);
+            pw_return_if_error(&status);
+
+        } else if (parser->line_continues) {
+            // end of window, read next part of the line
+            PwValue status = _mw_read_line_part(parser, pos);
+            pw_return_if_error(&status);
+            continue;
         }
         // read next line
         PwValue status = _mw_read_block_line(parser);
@@ -44,6 +115,9 @@ static PwResult parse_number(MwParser* parser, unsigned start_pos, unsigned* end
  * `start_pos` points to the sign or first digit
  */
 {
+    PwValue status = extend_window_to_number_end(parser, &start_pos);
+    pw_return_if_error(&status);
+
     int sign = 1;
     char32_t chr = pw_char_at(&parser->current_line, start_pos);
     if (chr == '+') {
@@ -62,12 +136,153 @@ static PwResult parse_string(MwParser* parser, unsigned start_pos, unsigned* end
  */
 {
     unsigned closing_quote_pos;
-    if (_mw_find_closing_quote(&parser->current_line, '"', start_pos + 1, &closing_quote_pos)) {
-        *end_pos = closing_quote_pos + 1;
-        return _mw_unescape_line(parser, &parser->current_line,
-                                  parser->line_number, '"', start_pos + 1, closing_quote_pos);
+    while (!_mw_find_closing_quote(&parser->current_line, '"', start_pos + 1, &closing_quote_pos)) {
+        if (!parser->line_continues) {
+            return mw_parser_error(parser, parser->current_indent, "String has no closing quote");
+        }
+        // the string continues in the next part of the line
+        PwValue status = _mw_read_line_part(parser, &start_pos);
+        pw_return_if_error(&status);
+    }
+    *end_pos = closing_quote_pos + 1;
+    return _mw_unescape_line(parser, &parser->current_line,
+                              parser->line_number, '"', start_pos + 1, closing_quote_pos);
+}
+
+static unsigned count_items(MwParser* parser, unsigned start_pos, char32_t closing_bracket)
+/*
+ * Count items of array or object starting from `start_pos` that points
+ * to the next character after opening bracket.
+ *
+ * This is a cheap lookahead to allocate containers at their final capacity.
+ * Only the current line is scanned, which is the case of minified JSON.
+ *
+ * Nested containers are scanned again by their own lookahead, so the scan
+ * is limited to LOOKAHEAD_LIMIT characters to keep parsing linear.
+ * Beyond the limit nested containers grow as usual, and the number of items
+ * of the outermost container is extrapolated from the scanned part,
+ * because in minified JSON it spans the rest of the line, e.g. a big table.
+ *
+ * Return the number of items found or estimated,
+ * or zero if the current line has no closing bracket.
+ */
+{
+    PwValuePtr current_line = &parser->current_line;
+
+    unsigned depth = 0;
+    unsigned count = 0;
+    bool empty = true;
+    unsigned pos = start_pos;
+    while (pw_string_index_valid(current_line, pos)) {
+        if (pos - start_pos >= LOOKAHEAD_LIMIT) {
+            if (parser->json_depth > 1 || count == 0) {
+                // lower bound
+                return count;
+            }
+            // each item takes at least two characters, including separator
+            unsigned remaining = pw_strlen(current_line) - start_pos;
+            uint64_t estimate = (uint64_t) count * remaining / (pos - start_pos);
+            return (unsigned) ((estimate < remaining / 2)? estimate : remaining / 2);
+        }
+        char32_t chr = pw_char_at(current_line, pos);
+        switch (chr) {
+            case ' ':
+            case '\t':
+                break;
+            case MW_COMMENT:
+                // comment lasts till the end of line
+                return 0;
+            case '"': {
+                unsigned closing_quote_pos;
+                if (!_mw_find_closing_quote(current_line, '"', pos + 1, &closing_quote_pos)) {
+                    return 0;
+                }
+                pos = closing_quote_pos;
+                empty = false;
+                break;
+            }
+            case '[':
+            case '{':
+                depth++;
+                empty = false;
+                break;
+            case ']':
+            case '}':
+                if (depth == 0) {
+                    if (chr != closing_bracket) {
+                        return 0;
+                    }
+                    return empty? 0 : count + 1;
+                }
+                depth--;
+                break;
+            case ',':
+                if (depth == 0) {
+                    count++;
+                }
+                break;
+            default:
+                empty = false;
+                break;
+        }
+        pos++;
     }
-    return mw_parser_error(parser, parser->current_indent, "String has no closing quote");
+    return 0;
+}
+
+static bool packable(PwValuePtr array, PwValuePtr item)
+{
+    if (mw_packed_type(array) == MW_PACKED_INT64) {
+        return pw_is_signed(item);
+    } else {
+        return pw_is_float(item);
+    }
+}
+
+static PwResult append_item(PwValuePtr array, PwValuePtr item)
+/*
+ * Append item to Array or packed array.
+ *
+ * Packed array holds either signed integers or floats only.
+ * It becomes Array of boxed values on first item of other type,
+ * so packing never changes returned values.
+ */
+{
+    if (!mw_is_packed_array(array)) {
+        return pw_array_append(array, item);
+    }
+    if (packable(array, item)) {
+        return mw_packed_append(array, item);
+    }
+    PwValue unpacked = mw_packed_to_array(array);
+    pw_return_if_error(&unpacked);
+
+    pw_destroy(array);
+    *array = pw_move(&unpacked);
+    return pw_array_append(array, item);
+}
+
+static PwResult create_array(MwParser* parser, PwValuePtr first_item, unsigned capacity)
+/*
+ * Create packed array if enabled and first item is a signed integer or float,
+ * otherwise create Array.
+ */
+{
+    if (parser->pack_json_arrays) {
+        if (pw_is_signed(first_item)) {
+            return mw_create_packed_array(MW_PACKED_INT64, capacity);
+        }
+        if (pw_is_float(first_item)) {
+            return mw_create_packed_array(MW_PACKED_FLOAT64, capacity);
+        }
+    }
+    PwValue result = PwArray();
+    pw_return_if_error(&result);
+
+    if (capacity > 1) {
+        pw_expect_ok( pw_array_resize(&result, capacity) );
+    }
+    return pw_move(&result);
 }
 
 static PwResult parse_array(MwParser* parser, unsigned start_pos, unsigned* end_pos)
@@ -75,26 +290,49 @@ static PwResult parse_array(MwParser* parser, unsigned start_pos, unsigned* end_
  * `start_pos` points to the next character after opening square bracket
  */
 {
+    MW_TRACE_SPAN("json_array", parser->line_number);
+
     parser->json_depth++;
+    if (parser->stats_enabled && parser->json_depth > parser->stats.max_json_depth) {
+        parser->stats.max_json_depth = parser->json_depth;
+    }
 
-    PwValue result = PwArray();
-    pw_return_if_error(&result);
+    // the array is created when the type of first item is known
+    PwValue result = PwNull();
+    unsigned capacity = 0;
+    if (!parser->validate_only) {
+        capacity = count_items(parser, start_pos, ']');
+    }
 
     PwValue chr = skip_spaces(parser, &start_pos, __LINE__);
     pw_return_if_error(&chr);
 
     if (chr.unsigned_value == ']') {
         // empty array
+        if (!parser->validate_only) {
+            result = PwArray();
+            pw_return_if_error(&result);
+        }
         *end_pos = start_pos + 1;
         parser->json_depth--;
         return pw_move(&result);
     }
 
     // parse first item
+    PwValue status = _mw_count_node(parser);
+    pw_return_if_error(&status);
+
     PwValue first_item = _mw_parse_json_value(parser, start_pos, &start_pos);
     pw_return_if_error(&first_item);
 
-    pw_expect_ok( pw_array_append(&result, &first_item) );
+    if (!parser->validate_only) {
+        _mw_count_value(parser, &first_item);
+
+        result = create_array(parser, &first_item, capacity);
+        pw_return_if_error(&result);
+
+        pw_expect_ok( append_item(&result, &first_item) );
+    }
 
     // parse subsequent items
     for (;;) {{
@@ -110,10 +348,16 @@ static PwResult parse_array(MwParser* parser, unsigned start_pos, unsigned* end_
         if (chr.unsigned_value != ',') {
             return mw_parser_error(parser, parser->current_indent, "Array items must be separated with comma");
         }
+        status = _mw_count_node(parser);
+        pw_return_if_error(&status);
+
         PwValue item = _mw_parse_json_value(parser, start_pos + 1, &start_pos);
         pw_return_if_error(&item);
 
-        pw_expect_ok( pw_array_append(&result, &item) );
+        if (!parser->validate_only) {
+            _mw_count_value(parser, &item);
+            pw_expect_ok( append_item(&result, &item) );
+        }
     }}
 }
 
@@ -124,6 +368,9 @@ static PwResult parse_object_member(MwParser* parser, unsigned* pos, PwValuePtr
  * Update `pos` on exit.
  */
 {
+    PwValue status = _mw_count_node(parser);
+    pw_return_if_error(&status);
+
     PwValue key = parse_string(parser, *pos, pos);
     pw_return_if_error(&key);
 
@@ -139,6 +386,10 @@ static PwResult parse_object_member(MwParser* parser, unsigned* pos, PwValuePtr
     PwValue value = _mw_parse_json_value(parser, *pos, pos);
     pw_return_if_error(&value);
 
+    if (parser->validate_only) {
+        return PwOK();
+    }
+    _mw_count_value(parser, &value);
     return pw_map_update(result, &key, &value);
 }
 
@@ -147,10 +398,23 @@ static PwResult parse_object(MwParser* parser, unsigned start_pos, unsigned* end
  * `start_pos` points to the next character after opening curly bracket
  */
 {
+    MW_TRACE_SPAN("json_object", parser->line_number);
+
     parser->json_depth++;
+    if (parser->stats_enabled && parser->json_depth > parser->stats.max_json_depth) {
+        parser->stats.max_json_depth = parser->json_depth;
+    }
 
-    PwValue result = PwMap();
-    pw_return_if_error(&result);
+    PwValue result = PwNull();
+    if (!parser->validate_only) {
+        result = PwMap();
+        pw_return_if_error(&result);
+
+        unsigned capacity = count_items(parser, start_pos, '}');
+        if (capacity > 1) {
+            pw_expect_ok( pw_map_resize(&result, capacity) );
+        }
+    }
 
     PwValue chr = skip_spaces(parser, &start_pos, __LINE__);
     pw_return_if_error(&chr);
@@ -212,6 +476,9 @@ PwResult _mw_parse_json_value(MwParser* parser, unsigned start_pos, unsigned* en
     if (chr == '+' || chr == '-' || pw_isdigit(chr)) {
         return parse_number(parser, start_pos, end_pos);
     }
+    PwValue status = extend_window(parser, &start_pos, 5);
+    pw_return_if_error(&status);
+
     if (pw_substring_eq(&parser->current_line, start_pos, start_pos + 4, "null")) {
         *end_pos = start_pos + 4;
         return PwNull();
@@ -229,6 +496,8 @@ PwResult _mw_parse_json_value(MwParser* parser, unsigned start_pos, unsigned* en
 
 PwResult _mw_json_parser_func(MwParser* parser)
 {
+    MW_TRACE_SPAN("json", parser->line_number);
+
     unsigned end_pos;
     PwValue result = _mw_parse_json_value(parser, _mw_get_start_position(parser), &end_pos);
     pw_return_if_error(&result);
@@ -250,12 +519,32 @@ PwResult _mw_json_parser_func(MwParser* parser)
     return pw_move(&result);
 }
 
-PwResult mw_parse_json(PwValuePtr markup)
+static PwResult check_line_end(MwParser* parser, unsigned pos)
+/*
+ * Return true if the rest of the current line, including all its parts,
+ * contains nothing but spaces and comment.
+ */
 {
-    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
-    if (!parser) {
-        return PwOOM();
+    for (;;) {
+        pos = pw_string_skip_spaces(&parser->current_line, pos);
+        if (pw_string_index_valid(&parser->current_line, pos)) {
+            if (pw_char_at(&parser->current_line, pos) != MW_COMMENT) {
+                return PwBool(false);
+            }
+            PwValue status = skip_line_rest(parser);
+            pw_return_if_error(&status);
+            return PwBool(true);
+        }
+        if (!parser->line_continues) {
+            return PwBool(true);
+        }
+        PwValue status = _mw_read_line_part(parser, &pos);
+        pw_return_if_error(&status);
     }
+}
+
+static PwResult parse_document(MwParser* parser)
+{
     // read first line to prepare for parsing and to detect EOF
     PwValue status = _mw_read_block_line(parser);
     pw_return_if_error(&status);
@@ -269,7 +558,9 @@ PwResult mw_parse_json(PwValuePtr markup)
 
     static char extra_data[] = "Extra data after parsed value";
 
-    if (!_mw_comment_or_end_of_line(parser, end_pos)) {
+    PwValue line_end = check_line_end(parser, end_pos);
+    pw_return_if_error(&line_end);
+    if (!line_end.bool_value) {
         return mw_parser_error(parser, parser->current_indent, extra_data);
     }
     // make sure current block has no more data
@@ -282,3 +573,21 @@ PwResult mw_parse_json(PwValuePtr markup)
     }
     return pw_move(&result);
 }
+
+PwResult mw_parser_parse_json(MwParser* parser)
+{
+    parser->read_line_parts = true;
+    PwValue result = parse_document(parser);
+    parser->read_line_parts = false;
+    parser->line_continues = false;
+    return pw_move(&result);
+}
+
+PwResult mw_parse_json(PwValuePtr markup)
+{
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
+    if (!parser) {
+        return PwOOM();
+    }
+    return mw_parser_parse_json(parser);
+}
@@ -0,0 +1,411 @@
+#ifdef MW_HAVE_IO_URING
+    // for struct statx
+#   define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef MW_HAVE_IO_URING
+#   include <liburing.h>
+#endif
+
+#include <myaw.h>
+
+/*
+ * Bulk file loading.
+ *
+ * With io_uring, up to LOAD_QUEUE_DEPTH files are in flight at once.
+ * Each file goes through open, statx, and read requests, and is closed
+ * and parsed as soon as its last read completes, while the kernel
+ * is working on the others. Descriptors are closed synchronously,
+ * so no descriptor is left behind if the ring fails. In that case
+ * pending requests are cancelled and all their completions are awaited
+ * before unfinished files are loaded with plain syscalls.
+ *
+ * Each file in flight occupies a slot with a buffer. Slots are reused
+ * for subsequent files, so buffers are reallocated only when they have to grow.
+ */
+
+#define LOAD_QUEUE_DEPTH  64
+
+typedef enum {
+    OP_OPEN,
+    OP_STAT,
+    OP_READ
+} LoadOp;
+
+typedef struct {
+    unsigned index;     // index of file in `paths`
+    bool     busy;
+    LoadOp   op;        // pending request
+    int      fd;
+    char*    buffer;
+    size_t   capacity;
+    size_t   size;      // file size
+    size_t   offset;    // number of bytes read so far
+#ifdef MW_HAVE_IO_URING
+    struct statx stx;
+#endif
+} LoadSlot;
+
+static bool reserve_buffer(LoadSlot* slot, size_t size)
+/*
+ * Make sure slot buffer can hold `size` bytes plus terminating zero.
+ */
+{
+    if (slot->capacity > size) {
+        return true;
+    }
+    char* buffer = realloc(slot->buffer, size + 1);
+    if (!buffer) {
+        return false;
+    }
+    slot->buffer = buffer;
+    slot->capacity = size + 1;
+    return true;
+}
+
+static PwResult parse_buffer(LoadSlot* slot)
+{
+    slot->buffer[slot->offset] = 0;
+
+    // the file may contain zero bytes
+    PwValue text = _mw_create_string(slot->buffer, slot->offset);
+    pw_return_if_error(&text);
+
+    PwValue reader = pw_create_string_io(&text);
+    pw_return_if_error(&reader);
+
+    return mw_parse(&reader);
+}
+
+static void set_result(PwValuePtr results, LoadSlot* slot, PwValuePtr value)
+{
+    PwValuePtr result = &results[slot->index];
+    pw_destroy(result);
+    *result = pw_move(value);
+}
+
+static PwResult read_file(char* path, LoadSlot* slot)
+/*
+ * Read file into slot buffer with plain syscalls.
+ */
+{
+    slot->offset = 0;
+
+    // non-blocking open does not hang on FIFOs
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd == -1) {
+        return PwErrno(errno);
+    }
+    int err = 0;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        err = errno;
+        goto out;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        err = EINVAL;
+        goto out;
+    }
+    slot->size = st.st_size;
+    if (!reserve_buffer(slot, slot->size)) {
+        close(fd);
+        return PwOOM();
+    }
+    while (slot->offset < slot->size) {
+        ssize_t n = read(fd, slot->buffer + slot->offset, slot->size - slot->offset);
+        if (n == 0) {
+            // file was truncated
+            break;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err = errno;
+            goto out;
+        }
+        slot->offset += n;
+    }
+
+out:
+    close(fd);
+    if (err) {
+        return PwErrno(err);
+    }
+    return PwOK();
+}
+
+static void load_file_plain(char** paths, PwValuePtr results, LoadSlot* slot)
+{
+    PwValue result = read_file(paths[slot->index], slot);
+    if (pw_ok(&result)) {
+        pw_destroy(&result);
+        result = parse_buffer(slot);
+    }
+    set_result(results, slot, &result);
+}
+
+static void load_files_plain(char** paths, unsigned start, unsigned n, PwValuePtr results, LoadSlot* slot)
+{
+    for (unsigned i = start; i < n; i++) {
+        slot->index = i;
+        load_file_plain(paths, results, slot);
+    }
+}
+
+#ifdef MW_HAVE_IO_URING
+
+static void submit_open(struct io_uring* ring, LoadSlot* slot, char* path)
+{
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    io_uring_prep_openat(sqe, AT_FDCWD, path, O_RDONLY | O_CLOEXEC | O_NONBLOCK, 0);
+    io_uring_sqe_set_data(sqe, slot);
+    slot->op = OP_OPEN;
+    slot->busy = true;
+    slot->offset = 0;
+}
+
+static void submit_stat(struct io_uring* ring, LoadSlot* slot)
+{
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    io_uring_prep_statx(sqe, slot->fd, "", AT_EMPTY_PATH, STATX_TYPE | STATX_SIZE, &slot->stx);
+    io_uring_sqe_set_data(sqe, slot);
+    slot->op = OP_STAT;
+}
+
+static void submit_read(struct io_uring* ring, LoadSlot* slot)
+{
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    io_uring_prep_read(sqe, slot->fd, slot->buffer + slot->offset,
+                       slot->size - slot->offset, slot->offset);
+    io_uring_sqe_set_data(sqe, slot);
+    slot->op = OP_READ;
+}
+
+static void fail_file(PwValuePtr results, LoadSlot* slot, PwValuePtr error)
+{
+    close(slot->fd);
+    set_result(results, slot, error);
+}
+
+static void file_loaded(struct io_uring* ring, PwValuePtr results, LoadSlot* slot)
+{
+    close(slot->fd);
+
+    // let the kernel work on other files while this one is being parsed
+    io_uring_submit(ring);
+
+    PwValue result = parse_buffer(slot);
+    set_result(results, slot, &result);
+}
+
+static bool handle_completion(struct io_uring* ring, PwValuePtr results, LoadSlot* slot, int res)
+/*
+ * Submit next request for the file.
+ * Return false when the file is done and slot is free.
+ */
+{
+    switch (slot->op) {
+        case OP_OPEN:
+            if (res < 0) {
+                PwValue error = PwErrno(-res);
+                set_result(results, slot, &error);
+                return false;
+            }
+            slot->fd = res;
+            submit_stat(ring, slot);
+            return true;
+
+        case OP_STAT:
+            if (res < 0) {
+                PwValue error = PwErrno(-res);
+                fail_file(results, slot, &error);
+                return false;
+            }
+            if (!S_ISREG(slot->stx.stx_mode)) {
+                // same as _mw_read_fd, devices and FIFOs are rejected
+                PwValue error = PwErrno(EINVAL);
+                fail_file(results, slot, &error);
+                return false;
+            }
+            slot->size = slot->stx.stx_size;
+            if (!reserve_buffer(slot, slot->size)) {
+                PwValue error = PwOOM();
+                fail_file(results, slot, &error);
+                return false;
+            }
+            if (slot->size == 0) {
+                file_loaded(ring, results, slot);
+                return false;
+            }
+            submit_read(ring, slot);
+            return true;
+
+        case OP_READ:
+            if (res == -EINTR || res == -EAGAIN) {
+                submit_read(ring, slot);
+                return true;
+            }
+            if (res < 0) {
+                PwValue error = PwErrno(-res);
+                fail_file(results, slot, &error);
+                return false;
+            }
+            slot->offset += res;
+            if (res == 0 || slot->offset == slot->size) {
+                // zero means the file was truncated, parse what was read
+                file_loaded(ring, results, slot);
+                return false;
+            }
+            submit_read(ring, slot);
+            return true;
+    }
+    return false;
+}
+
+static void cancel_requests(struct io_uring* ring, unsigned active)
+/*
+ * Cancel requests of `active` slots and wait for all completions
+ * so that the kernel no longer writes to slot buffers.
+ * Descriptors returned by opens that completed meanwhile are closed,
+ * slots keep their state for loading files the plain way.
+ */
+{
+    // requests still in the submission queue are not known to the kernel
+    unsigned pending = active - io_uring_sq_ready(ring);
+
+    struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+    if (sqe) {
+        io_uring_prep_cancel(sqe, nullptr, IORING_ASYNC_CANCEL_ANY);
+        io_uring_sqe_set_data(sqe, nullptr);
+        int submitted = io_uring_submit(ring);
+        if (submitted > 0) {
+            pending += submitted;
+        }
+    }
+    while (pending) {
+        struct io_uring_cqe* cqe;
+        int err = io_uring_wait_cqe(ring, &cqe);
+        if (err == -EINTR) {
+            continue;
+        }
+        if (err < 0) {
+            break;
+        }
+        LoadSlot* slot = io_uring_cqe_get_data(cqe);
+        if (slot && slot->op == OP_OPEN && cqe->res >= 0) {
+            close(cqe->res);
+        }
+        io_uring_cqe_seen(ring, cqe);
+        pending--;
+    }
+}
+
+static bool load_files_uring(char** paths, unsigned n, PwValuePtr results, LoadSlot* slots)
+/*
+ * Return false if io_uring is not available.
+ */
+{
+    struct io_uring ring;
+    if (io_uring_queue_init(LOAD_QUEUE_DEPTH, &ring, 0) < 0) {
+        return false;
+    }
+    // each slot has at most one pending request, so submission queue never overflows
+    unsigned next_file = 0;
+    unsigned active = 0;
+    for (; active < LOAD_QUEUE_DEPTH && next_file < n; active++) {
+        slots[active].index = next_file;
+        submit_open(&ring, &slots[active], paths[next_file]);
+        next_file++;
+    }
+    while (active) {
+        struct io_uring_cqe* cqe;
+        int err = io_uring_submit_and_wait(&ring, 1);
+        if (err == -EINTR) {
+            continue;
+        }
+        if (err == -EBUSY || err == -EAGAIN) {
+            // completion queue is full or the kernel is short of resources:
+            // reap completions, or wait for requests already submitted, and retry
+            if (io_uring_cq_ready(&ring) == 0) {
+                if (active == io_uring_sq_ready(&ring)) {
+                    // nothing to wait for
+                    cancel_requests(&ring, active);
+                    break;
+                }
+                err = io_uring_wait_cqe(&ring, &cqe);
+                if (err < 0 && err != -EINTR) {
+                    cancel_requests(&ring, active);
+                    break;
+                }
+            }
+        } else if (err < 0) {
+            // the ring has failed
+            cancel_requests(&ring, active);
+            break;
+        }
+        while (io_uring_peek_cqe(&ring, &cqe) == 0) {
+            LoadSlot* slot = io_uring_cqe_get_data(cqe);
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+
+            if (handle_completion(&ring, results, slot, res)) {
+                continue;
+            }
+            slot->busy = false;
+            if (next_file < n) {
+                slot->index = next_file;
+                submit_open(&ring, slot, paths[next_file]);
+                next_file++;
+            } else {
+                active--;
+            }
+        }
+    }
+    io_uring_queue_exit(&ring);
+
+    if (active) {
+        // the ring has failed, load unfinished files the plain way
+        for (unsigned i = 0; i < LOAD_QUEUE_DEPTH; i++) {
+            LoadSlot* slot = &slots[i];
+            if (!slot->busy) {
+                continue;
+            }
+            if (slot->op != OP_OPEN) {
+                // the file was opened by the ring
+                close(slot->fd);
+            }
+            load_file_plain(paths, results, slot);
+        }
+        load_files_plain(paths, next_file, n, results, slots);
+    }
+    return true;
+}
+
+#endif
+
+PwResult mw_load_files(char** paths, unsigned n, PwValuePtr results)
+{
+    LoadSlot* slots = allocate(sizeof(LoadSlot) * LOAD_QUEUE_DEPTH, true);
+    if (!slots) {
+        return PwOOM();
+    }
+#ifdef MW_HAVE_IO_URING
+    if (!load_files_uring(paths, n, results, slots)) {
+        load_files_plain(paths, 0, n, results, slots);
+    }
+#else
+    load_files_plain(paths, 0, n, results, slots);
+#endif
+    for (unsigned i = 0; i < LOAD_QUEUE_DEPTH; i++) {
+        free(slots[i].buffer);
+    }
+    release((void**) &slots, sizeof(LoadSlot) * LOAD_QUEUE_DEPTH);
+    return PwOK();
+}
@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <myaw.h>
+
+/*
+ * Packed numeric arrays.
+ *
+ * Items are stored in a contiguous vector of int64_t or double
+ * instead of an array of boxed values.
+ */
+
+#define MIN_CAPACITY  16
+
+PwTypeId PwTypeId_MwPackedArray = 0;
+
+static char32_t number_terminators[] = { MW_COMMENT, ',', 0 };
+
+static size_t item_size(MwPackedType item_type)
+{
+    return (item_type == MW_PACKED_INT64)? sizeof(int64_t) : sizeof(double);
+}
+
+static bool reserve(MwPackedArrayData* data, unsigned capacity)
+{
+    if (capacity <= data->capacity) {
+        return true;
+    }
+    if (capacity < MIN_CAPACITY) {
+        capacity = MIN_CAPACITY;
+    }
+    void* items = realloc(data->items, capacity * item_size(data->item_type));
+    if (!items) {
+        return false;
+    }
+    data->items = items;
+    data->capacity = capacity;
+    return true;
+}
+
+static inline bool fits_int64(PwValuePtr number)
+{
+    if (pw_is_signed(number)) {
+        return true;
+    }
+    return pw_is_unsigned(number) && number->unsigned_value <= INT64_MAX;
+}
+
+static inline bool grow(MwPackedArrayData* data)
+{
+    if (data->length < data->capacity) {
+        return true;
+    }
+    return reserve(data, data->capacity * 2);
+}
+
+PwResult mw_create_packed_array(MwPackedType item_type, unsigned capacity)
+{
+    PwValue result = pw_create(PwTypeId_MwPackedArray);
+    pw_return_if_error(&result);
+
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(&result);
+    data->item_type = item_type;
+    if (capacity && !reserve(data, capacity)) {
+        return PwOOM();
+    }
+    return pw_move(&result);
+}
+
+bool mw_is_packed_array(PwValuePtr value)
+{
+    return value->type_id == PwTypeId_MwPackedArray;
+}
+
+MwPackedType mw_packed_type(PwValuePtr array)
+{
+    return _mw_packed_array_data_ptr(array)->item_type;
+}
+
+unsigned mw_packed_length(PwValuePtr array)
+{
+    return _mw_packed_array_data_ptr(array)->length;
+}
+
+int64_t* mw_packed_int64_items(PwValuePtr array)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(array);
+    return (data->item_type == MW_PACKED_INT64)? data->int64_items : nullptr;
+}
+
+double* mw_packed_float64_items(PwValuePtr array)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(array);
+    return (data->item_type == MW_PACKED_FLOAT64)? data->float64_items : nullptr;
+}
+
+bool mw_packed_append_int64(PwValuePtr array, int64_t item)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(array);
+    if (data->item_type != MW_PACKED_INT64 || !grow(data)) {
+        return false;
+    }
+    data->int64_items[data->length++] = item;
+    return true;
+}
+
+bool mw_packed_append_float64(PwValuePtr array, double item)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(array);
+    if (data->item_type != MW_PACKED_FLOAT64 || !grow(data)) {
+        return false;
+    }
+    data->float64_items[data->length++] = item;
+    return true;
+}
+
+PwResult mw_packed_append(PwValuePtr array, PwValuePtr number)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(array);
+    if (data->item_type == MW_PACKED_INT64) {
+        if (!fits_int64(number)) {
+            return PwError(MW_UNSUPPORTED_TYPE);
+        }
+        int64_t item = pw_is_signed(number)? number->signed_value : (int64_t) number->unsigned_value;
+        if (!grow(data)) {
+            return PwOOM();
+        }
+        data->int64_items[data->length++] = item;
+    } else {
+        double item;
+        if (pw_is_float(number)) {
+            item = number->float_value;
+        } else if (pw_is_signed(number)) {
+            item = (double) number->signed_value;
+        } else if (pw_is_unsigned(number)) {
+            item = (double) number->unsigned_value;
+        } else {
+            return PwError(MW_UNSUPPORTED_TYPE);
+        }
+        if (!grow(data)) {
+            return PwOOM();
+        }
+        data->float64_items[data->length++] = item;
+    }
+    return PwOK();
+}
+
+PwResult mw_packed_item(PwValuePtr array, unsigned index)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(array);
+    if (index >= data->length) {
+        return PwError(PW_ERROR_INDEX_OUT_OF_RANGE);
+    }
+    if (data->item_type == MW_PACKED_INT64) {
+        return PwSigned(data->int64_items[index]);
+    } else {
+        return PwFloat(data->float64_items[index]);
+    }
+}
+
+PwResult mw_packed_to_array(PwValuePtr array)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(array);
+
+    PwValue result = PwArray();
+    pw_return_if_error(&result);
+
+    if (data->length > 1) {
+        pw_expect_ok( pw_array_resize(&result, data->length) );
+    }
+    for (unsigned i = 0; i < data->length; i++) {{
+        PwValue item = mw_packed_item(array, i);
+        pw_expect_ok( pw_array_append(&result, &item) );
+    }}
+    return pw_move(&result);
+}
+
+static PwResult parse_packed_array(MwParser* parser, MwPackedType item_type)
+/*
+ * Parse numbers separated with spaces and/or commas from block lines.
+ * Comments are allowed at the end of lines.
+ */
+{
+    PwValue result = PwNull();
+    if (!parser->validate_only) {
+        result = mw_create_packed_array(item_type, 0);
+        pw_return_if_error(&result);
+    }
+
+    MwBlockReader reader;
+    mw_block_reader_init(&reader, parser);
+    for (;;) {{
+        MwBlockLine line;
+        PwValue status = mw_block_reader_next(&reader, &line);
+        if (_mw_end_of_block(&status)) {
+            return pw_move(&result);
+        }
+        pw_return_if_error(&status);
+
+        unsigned pos = line.start;
+        while (pos < line.end) {{
+            char32_t chr = pw_char_at(line.line, pos);
+            if (chr == ' ' || chr == '\t' || chr == ',') {
+                pos++;
+                continue;
+            }
+            if (chr == MW_COMMENT) {
+                break;
+            }
+            int sign = 1;
+            unsigned start_pos = pos;
+            if (chr == '+') {
+                pos++;
+            } else if (chr == '-') {
+                sign = -1;
+                pos++;
+            }
+            PwValue number = _mw_parse_number(parser, pos, sign, &pos, number_terminators);
+            pw_return_if_error(&number);
+
+            if (item_type == MW_PACKED_INT64 && !fits_int64(&number)) {
+                return mw_parser_error2(parser, line.line_number, start_pos, "Integer out of range or expected");
+            }
+            if (!parser->validate_only) {
+                status = mw_packed_append(&result, &number);
+                pw_return_if_error(&status);
+            }
+        }}
+    }}
+}
+
+PwResult _mw_int64_array_parser_func(MwParser* parser)
+{
+    return parse_packed_array(parser, MW_PACKED_INT64);
+}
+
+PwResult _mw_float64_array_parser_func(MwParser* parser)
+{
+    return parse_packed_array(parser, MW_PACKED_FLOAT64);
+}
+
+static PwResult mw_packed_array_init(PwValuePtr self, void* ctor_args)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(self);
+    data->item_type = MW_PACKED_INT64;
+    data->length = 0;
+    data->capacity = 0;
+    data->items = nullptr;
+    return PwOK();
+}
+
+static void mw_packed_array_fini(PwValuePtr self)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(self);
+    free(data->items);
+    data->items = nullptr;
+    data->length = 0;
+    data->capacity = 0;
+}
+
+static void mw_packed_array_hash(PwValuePtr self, PwHashContext* ctx)
+{
+    MwPackedArrayData* data = _mw_packed_array_data_ptr(self);
+
+    _pw_hash_uint64(ctx, self->type_id);
+    _pw_hash_uint64(ctx, data->item_type);
+    _pw_hash_uint64(ctx, data->length);
+    for (unsigned i = 0; i < data->length; i++) {
+        // both item types are 64 bit wide
+        uint64_t bits;
+        memcpy(&bits, &data->int64_items[i], sizeof(bits));
+        _pw_hash_uint64(ctx, bits);
+    }
+}
+
+static PwType mw_packed_array_type;
+
+[[ gnu::constructor ]]
+static void init_mw_packed_array()
+{
+    PwTypeId_MwPackedArray = pw_struct_subtype(&mw_packed_array_type, "MwPackedArray", PwTypeId_Struct, MwPackedArrayData);
+    mw_packed_array_type.init = mw_packed_array_init;
+    mw_packed_array_type.fini = mw_packed_array_fini;
+    mw_packed_array_type.hash = mw_packed_array_hash;
+}
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <myaw.h>
 #include <pw_parse.h>
@@ -9,7 +10,8 @@
 #define DEFAULT_LINE_CAPACITY  250
 
 #ifdef TRACE_ENABLED
-    static unsigned tracelevel = 0;
+    // parsers can run concurrently, each thread has its own trace indentation
+    static _Thread_local unsigned tracelevel = 0;
 
 #   define _TRACE_INDENT() \
         for (unsigned i = 0; i < tracelevel * 4; i++) {  \
@@ -63,6 +65,10 @@ static PwResult parse_literal_string(MwParser* parser);
 static PwResult parse_folded_string(MwParser* parser);
 static PwResult parse_datetime(MwParser* parser);
 static PwResult parse_timestamp(MwParser* parser);
+static PwResult parse_base64(MwParser* parser);
+static PwResult parse_anchor(MwParser* parser);
+static PwResult parse_ref(MwParser* parser);
+static void start_limits(MwParser* parser);
 
 static char32_t number_terminators[] = { MW_COMMENT, ':', 0 };
 
@@ -83,6 +89,10 @@ MwParser* mw_create_parser(PwValuePtr markup)
 
     parser->skip_comments = true;
 
+    parser->include_cache = PwNull();
+    parser->convspec_arg = PwNull();
+    parser->anchors = PwNull();
+
     PwValue status = PwNull();
 
     parser->current_line = pw_create_empty_string(DEFAULT_LINE_CAPACITY, 1);
@@ -95,17 +105,29 @@ MwParser* mw_create_parser(PwValuePtr markup)
         PwCharPtr("folded"),    PwPtr((void*) parse_folded_string),
         PwCharPtr("datetime"),  PwPtr((void*) parse_datetime),
         PwCharPtr("timestamp"), PwPtr((void*) parse_timestamp),
+        PwCharPtr("base64"),    PwPtr((void*) parse_base64),
+        PwCharPtr("anchor"),    PwPtr((void*) parse_anchor),
+        PwCharPtr("ref"),       PwPtr((void*) parse_ref),
+        PwCharPtr("int64[]"),   PwPtr((void*) _mw_int64_array_parser_func),
+        PwCharPtr("float64[]"), PwPtr((void*) _mw_float64_array_parser_func),
         PwCharPtr("json"),      PwPtr((void*) _mw_json_parser_func)
     );
     if (pw_error(&parser->custom_parsers)) {
         goto error;
     }
-
-    status = pw_start_read_lines(markup);
-    if (pw_error(&status)) {
+    parser->convspecs_with_arg = PwMap(
+        PwCharPtr("anchor"),    PwBool(true)
+    );
+    if (pw_error(&parser->convspecs_with_arg)) {
         goto error;
     }
 
+    if (!pw_is_null(markup)) {
+        status = pw_start_read_lines(markup);
+        if (pw_error(&status)) {
+            goto error;
+        }
+    }
     return parser;
 
 error:
@@ -120,9 +142,42 @@ void mw_delete_parser(MwParser** parser_ptr)
     pw_destroy(&parser->markup);
     pw_destroy(&parser->current_line);
     pw_destroy(&parser->custom_parsers);
+    pw_destroy(&parser->convspecs_with_arg);
+    pw_destroy(&parser->include_cache);
+    pw_destroy(&parser->convspec_arg);
+    pw_destroy(&parser->anchors);
     release((void**) &parser, sizeof(MwParser));
 }
 
+PwResult mw_reset_parser(MwParser* parser, PwValuePtr markup)
+{
+    pw_destroy(&parser->markup);
+    parser->markup = pw_clone(markup);
+
+    parser->current_indent = 0;
+    parser->line_number = 0;
+    parser->block_indent = 0;
+    parser->blocklevel = 1;
+    parser->json_depth = 1;
+    parser->skip_comments = true;
+    parser->eof = false;
+
+    // anchors are local to document
+    pw_destroy(&parser->anchors);
+
+    start_limits(parser);
+    mw_reset_parser_stats(parser);
+
+    // line buffer is destroyed on EOF
+    if (pw_is_string(&parser->current_line)) {
+        pw_string_truncate(&parser->current_line, 0);
+    } else {
+        parser->current_line = pw_create_empty_string(DEFAULT_LINE_CAPACITY, 1);
+        pw_return_if_error(&parser->current_line);
+    }
+    return pw_start_read_lines(markup);
+}
+
 PwResult mw_set_custom_parser(MwParser* parser, char* convspec, MwBlockParserFunc parser_func)
 {
     PWDECL_CharPtr(key, convspec);
@@ -130,6 +185,16 @@ PwResult mw_set_custom_parser(MwParser* parser, char* convspec, MwBlockParserFun
     return pw_map_update(&parser->custom_parsers, &key, &value);
 }
 
+PwResult mw_set_custom_parser_with_arg(MwParser* parser, char* convspec, MwBlockParserFunc parser_func)
+{
+    PwValue status = mw_set_custom_parser(parser, convspec, parser_func);
+    pw_return_if_error(&status);
+
+    PWDECL_CharPtr(key, convspec);
+    PwValue value = PwBool(true);
+    return pw_map_update(&parser->convspecs_with_arg, &key, &value);
+}
+
 static inline bool have_custom_parser(MwParser* parser, PwValuePtr convspec)
 {
     return pw_map_has_key(&parser->custom_parsers, convspec);
@@ -164,27 +229,328 @@ static inline bool isspace_or_eol_at(PwValuePtr str, unsigned position)
     }
 }
 
+static uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void start_limits(MwParser* parser)
+/*
+ * Reset counters and start timeout.
+ */
+{
+    parser->input_size = 0;
+    parser->num_nodes = 0;
+    parser->alloc_size = 0;
+    if (parser->limits.timeout_ms) {
+        parser->deadline = monotonic_ns() + (uint64_t) parser->limits.timeout_ms * 1000000ULL;
+    } else {
+        parser->deadline = 0;
+    }
+}
+
+void mw_set_limits(MwParser* parser, MwLimits* limits)
+{
+    parser->limits = *limits;
+    start_limits(parser);
+}
+
+static PwResult limit_exceeded(MwParser* parser, char* what)
+{
+    PwValue error = mw_parser_error(parser, parser->current_indent, "%s limit exceeded", what);
+    if (error.status_code == MW_PARSE_ERROR) {
+        error.status_code = MW_LIMIT_EXCEEDED;
+    }
+    return pw_move(&error);
+}
+
+static inline PwResult check_deadline(MwParser* parser)
+{
+    if (parser->deadline && monotonic_ns() > parser->deadline) {
+        return limit_exceeded(parser, "Time");
+    }
+    return PwOK();
+}
+
+PwResult _mw_count_node(MwParser* parser)
+{
+    MwLimits* limits = &parser->limits;
+
+    parser->num_nodes++;
+    parser->alloc_size += 2 * sizeof(_PwValue);  // key and value, or array item with spare capacity
+
+    if (limits->max_nodes && parser->num_nodes > limits->max_nodes) {
+        return limit_exceeded(parser, "Node");
+    }
+    if (limits->max_alloc_size && parser->alloc_size > limits->max_alloc_size) {
+        return limit_exceeded(parser, "Memory");
+    }
+    if ((parser->num_nodes & 255) == 0) {
+        return check_deadline(parser);
+    }
+    return PwOK();
+}
+
+static PwResult count_string(MwParser* parser, size_t total_length, size_t line_length)
+/*
+ * Check limits for multi-line string or block which `total_length` includes
+ * `line_length` characters of the current line.
+ */
+{
+    MwLimits* limits = &parser->limits;
+
+    parser->alloc_size += line_length;
+
+    if (limits->max_string_length && total_length > limits->max_string_length) {
+        return limit_exceeded(parser, "String length");
+    }
+    if (limits->max_alloc_size && parser->alloc_size > limits->max_alloc_size) {
+        return limit_exceeded(parser, "Memory");
+    }
+    return PwOK();
+}
+
+MwParserStats* mw_parser_stats(MwParser* parser)
+{
+    parser->stats.alloc_size = parser->alloc_size;
+    return &parser->stats;
+}
+
+void mw_reset_parser_stats(MwParser* parser)
+{
+    memset(&parser->stats, 0, sizeof(MwParserStats));
+}
+
+PwResult mw_convspec_name(MwParser* parser, void* parser_func)
+{
+    unsigned n = pw_map_length(&parser->custom_parsers);
+    for (unsigned i = 0; i < n; i++) {{
+        PwValue convspec = PwNull();
+        PwValue func = PwNull();
+        pw_map_item(&parser->custom_parsers, i, &convspec, &func);
+        if (func.ptr == parser_func) {
+            return pw_move(&convspec);
+        }
+    }}
+    return PwNull();
+}
+
+void _mw_count_value(MwParser* parser, PwValuePtr value)
+{
+    if (!parser->stats_enabled || parser->value_emitted || parser->validate_only) {
+        // list or map passed to event handler is already counted,
+        // values are not materialized in validation mode
+        return;
+    }
+    MwParserStats* stats = &parser->stats;
+    if (pw_is_null(value)) {
+        stats->values[MW_STATS_NULL]++;
+    } else if (pw_is_bool(value)) {
+        stats->values[MW_STATS_BOOL]++;
+    } else if (pw_is_signed(value)) {
+        stats->values[MW_STATS_SIGNED]++;
+    } else if (pw_is_unsigned(value)) {
+        stats->values[MW_STATS_UNSIGNED]++;
+    } else if (pw_is_float(value)) {
+        stats->values[MW_STATS_FLOAT]++;
+    } else {
+        if (pw_is_string(value)) {
+            stats->values[MW_STATS_STRING]++;
+        } else if (pw_is_array(value)) {
+            stats->values[MW_STATS_LIST]++;
+        } else if (pw_is_map(value)) {
+            stats->values[MW_STATS_MAP]++;
+        } else {
+            stats->values[MW_STATS_OTHER]++;
+        }
+        stats->allocations++;
+    }
+}
+
+void _mw_count_container(MwParser* parser, MwStatsValueType type)
+{
+    if (parser->stats_enabled) {
+        parser->stats.values[type]++;
+        parser->stats.allocations++;
+    }
+}
+
+static void count_convspec(MwParser* parser, MwBlockParserFunc parser_func, uint64_t time_ns)
+{
+    MwParserStats* stats = &parser->stats;
+    for (unsigned i = 0; i < stats->num_convspecs; i++) {
+        if (stats->convspecs[i].parser_func == (void*) parser_func) {
+            stats->convspecs[i].calls++;
+            stats->convspecs[i].time_ns += time_ns;
+            return;
+        }
+    }
+    if (stats->num_convspecs < MW_MAX_STATS_CONVSPECS) {
+        MwConvspecStats* entry = &stats->convspecs[stats->num_convspecs++];
+        entry->parser_func = (void*) parser_func;
+        entry->calls = 1;
+        entry->time_ns = time_ns;
+    }
+}
+
+static PwResult call_parser_func(MwParser* parser, MwBlockParserFunc parser_func)
+/*
+ * Call parser function, update statistics and trace conversion specifiers.
+ */
+{
+    if (parser_func == value_parser_func) {
+        return parser_func(parser);
+    }
+    MW_TRACE_SPAN("convspec", parser->line_number);
+    if (_mw_trace_span.name) {
+        PwValue convspec = mw_convspec_name(parser, parser_func);
+        _mw_trace_span_detail(&_mw_trace_span, &convspec);
+    }
+    if (!parser->stats_enabled) {
+        return parser_func(parser);
+    }
+    uint64_t start_time = monotonic_ns();
+    PwValue result = parser_func(parser);
+    count_convspec(parser, parser_func, monotonic_ns() - start_time);
+    return pw_move(&result);
+}
+
 static PwResult read_line(MwParser* parser)
 /*
  * Read line into parser->current line and strip trailing spaces.
  * Return status.
  */
 {
-    PwValue status = pw_read_line_inplace(&parser->markup, &parser->current_line);
+    // drop the rest of the previous line if it was read in parts
+    while (parser->line_continues) {
+        unsigned pos = pw_strlen(&parser->current_line);
+        PwValue status = _mw_read_line_part(parser, &pos);
+        pw_return_if_error(&status);
+    }
+    PwValue status = PwNull();
+    if (parser->line_reader) {
+        MwLineReader* reader = parser->line_reader;
+        if (parser->read_line_parts && reader->read_line_part) {
+            status = reader->read_line_part(reader, &parser->current_line,
+                                            MW_JSON_WINDOW_SIZE, &parser->line_continues);
+        } else {
+            status = reader->read_line(reader, &parser->current_line);
+        }
+    } else {
+        status = pw_read_line_inplace(&parser->markup, &parser->current_line);
+    }
     pw_return_if_error(&status);
 
     // strip trailing spaces
-    pw_expect_true( pw_string_rtrim(&parser->current_line) );
+    if (!parser->line_continues) {
+        pw_expect_true( pw_string_rtrim(&parser->current_line) );
+    }
 
     // measure indent
     parser->current_indent = pw_string_skip_spaces(&parser->current_line, 0);
 
     // set current_line
-    parser->line_number = pw_get_line_number(&parser->markup);
+    if (parser->line_reader) {
+        parser->line_number = parser->line_reader->line_number(parser->line_reader);
+    } else {
+        parser->line_number = pw_get_line_number(&parser->markup);
+    }
 
+    // check limits
+    MwLimits* limits = &parser->limits;
+    unsigned length = pw_strlen(&parser->current_line);
+    if (parser->stats_enabled) {
+        parser->stats.lines_read++;
+        parser->stats.chars_read += length + 1;
+    }
+    parser->input_size += length + 1;
+    if (limits->max_input_size && parser->input_size > limits->max_input_size) {
+        return limit_exceeded(parser, "Input size");
+    }
+    if (limits->max_string_length && length > limits->max_string_length) {
+        return limit_exceeded(parser, "String length");
+    }
+    if ((parser->line_number & 63) == 0) {
+        return check_deadline(parser);
+    }
     return PwOK();
 }
 
+PwResult _mw_read_line_part(MwParser* parser, unsigned* pos)
+{
+    if (!parser->line_continues) {
+        return PwOK();
+    }
+    PwValue part = pw_create_empty_string(MW_JSON_WINDOW_SIZE, 1);
+    pw_return_if_error(&part);
+
+    PwValue status = parser->line_reader->read_line_part(parser->line_reader, &part,
+                                                         MW_JSON_WINDOW_SIZE, &parser->line_continues);
+    if (pw_eof(&status)) {
+        parser->line_continues = false;
+        return PwOK();
+    }
+    pw_return_if_error(&status);
+
+    if (!parser->line_continues) {
+        pw_expect_true( pw_string_rtrim(&part) );
+    }
+    unsigned part_length = pw_strlen(&part);
+
+    // keep characters starting from `pos`, they belong to a value being parsed
+    unsigned length = pw_strlen(&parser->current_line);
+    if (*pos < length) {
+        PwValue window = pw_substr(&parser->current_line, *pos, length);
+        pw_return_if_error(&window);
+        if (!pw_string_append(&window, &part)) {
+            return PwOOM();
+        }
+        pw_destroy(&parser->current_line);
+        parser->current_line = pw_move(&window);
+    } else {
+        pw_destroy(&parser->current_line);
+        parser->current_line = pw_move(&part);
+    }
+    parser->current_indent = 0;
+    *pos = 0;
+
+    // check limits, same as for whole lines
+    if (parser->stats_enabled) {
+        parser->stats.chars_read += part_length;
+    }
+    parser->input_size += part_length;
+    MwLimits* limits = &parser->limits;
+    if (limits->max_input_size && parser->input_size > limits->max_input_size) {
+        return limit_exceeded(parser, "Input size");
+    }
+    if (limits->max_string_length && pw_strlen(&parser->current_line) > limits->max_string_length) {
+        return limit_exceeded(parser, "String length");
+    }
+    return check_deadline(parser);
+}
+
+static inline bool unread_line(MwParser* parser)
+{
+    bool unread;
+    if (parser->line_reader) {
+        unread = parser->line_reader->unread_line(parser->line_reader, &parser->current_line);
+    } else {
+        unread = pw_unread_line(&parser->markup, &parser->current_line);
+    }
+    if (unread) {
+        // the line will be counted again
+        size_t length = pw_strlen(&parser->current_line) + 1;
+        parser->input_size -= length;
+        if (parser->stats_enabled) {
+            parser->stats.lines_unread++;
+            parser->stats.chars_read -= length;
+        }
+    }
+    return unread;
+}
+
 static inline bool is_comment_line(MwParser* parser)
 /*
  * Return true if current line starts with MW_COMMENT char.
@@ -238,7 +604,7 @@ PwResult _mw_read_block_line(MwParser* parser)
         }
         TRACE("unindent");
         // end of block
-        if (!pw_unread_line(&parser->markup, &parser->current_line)) {
+        if (!unread_line(parser)) {
             return PwError(PW_ERROR_UNREAD_FAILED);
         }
         pw_string_truncate(&parser->current_line, 0);
@@ -246,6 +612,34 @@ PwResult _mw_read_block_line(MwParser* parser)
     }}
 }
 
+void mw_block_reader_init(MwBlockReader* reader, MwParser* parser)
+{
+    reader->parser = parser;
+    reader->started = false;
+    reader->length = 0;
+}
+
+PwResult mw_block_reader_next(MwBlockReader* reader, MwBlockLine* line)
+{
+    MwParser* parser = reader->parser;
+    if (reader->started) {
+        PwValue status = _mw_read_block_line(parser);
+        pw_return_if_error(&status);
+    } else {
+        // the first line is already read
+        reader->started = true;
+    }
+    unsigned length = pw_strlen(&parser->current_line);
+
+    line->line = &parser->current_line;
+    line->start = (parser->block_indent < length)? parser->block_indent : length;
+    line->end = length;
+    line->line_number = parser->line_number;
+
+    reader->length += line->end - line->start + 1;
+    return count_string(parser, reader->length, line->end - line->start);
+}
+
 PwResult _mw_read_block(MwParser* parser)
 {
     TRACEPOINT();
@@ -253,26 +647,24 @@ PwResult _mw_read_block(MwParser* parser)
     PwValue lines = PwArray();
     pw_return_if_error(&lines);
 
+    MwBlockReader reader;
+    mw_block_reader_init(&reader, parser);
     for (;;) {{
-        // append line
-        PwValue line = pw_substr(&parser->current_line, parser->block_indent, UINT_MAX);
-        pw_return_if_error(&line);
-
-        pw_expect_ok( pw_array_append(&lines, &line) );
-
-        // read next line
-        PwValue status = _mw_read_block_line(parser);
+        MwBlockLine block_line;
+        PwValue status = mw_block_reader_next(&reader, &block_line);
         if (_mw_end_of_block(&status)) {
             return pw_move(&lines);
         }
         pw_return_if_error(&status);
+
+        PwValue line = _mw_substr(block_line.line, block_line.start, block_line.end);
+        pw_return_if_error(&line);
+
+        pw_expect_ok( pw_array_append(&lines, &line) );
     }}
 }
 
-static PwResult parse_nested_block(MwParser* parser, unsigned block_pos, MwBlockParserFunc parser_func)
-/*
- * Set block indent to `block_pos` and call parser_func.
- */
+PwResult _mw_start_nested_block(MwParser* parser, unsigned block_pos, unsigned* saved_block_indent)
 {
     if (parser->blocklevel >= parser->max_blocklevel) {
         return mw_parser_error(parser, parser->current_indent, "Too many nested blocks");
@@ -280,26 +672,17 @@ static PwResult parse_nested_block(MwParser* parser, unsigned block_pos, MwBlock
 
     // start nested block
     parser->blocklevel++;
-    unsigned saved_block_indent = parser->block_indent;
+    if (parser->stats_enabled && parser->blocklevel > parser->stats.max_blocklevel) {
+        parser->stats.max_blocklevel = parser->blocklevel;
+    }
+    *saved_block_indent = parser->block_indent;
     parser->block_indent = block_pos;
 
     TRACE_ENTER();
-
-    // call parser function
-    PwValue result = parser_func(parser);
-
-    // end nested block
-    parser->block_indent = saved_block_indent;
-    parser->blocklevel--;
-
-    TRACE_EXIT();
-    return pw_move(&result);
+    return PwOK();
 }
 
-static PwResult parse_nested_block_from_next_line(MwParser* parser, MwBlockParserFunc parser_func)
-/*
- * Read next line, set block indent to current indent plus one, and call parser_func.
- */
+PwResult _mw_start_nested_block_from_next_line(MwParser* parser, unsigned* saved_block_indent)
 {
     TRACEPOINT();
     TRACE("new block_pos %u", parser->block_indent + 1);
@@ -315,8 +698,85 @@ static PwResult parse_nested_block_from_next_line(MwParser* parser, MwBlockParse
     }
     pw_return_if_error(&status);
 
-    // call parse_nested_block
-    return parse_nested_block(parser, parser->block_indent + 1, parser_func);
+    return _mw_start_nested_block(parser, parser->block_indent + 1, saved_block_indent);
+}
+
+void _mw_end_nested_block(MwParser* parser, unsigned saved_block_indent)
+{
+    parser->block_indent = saved_block_indent;
+    parser->blocklevel--;
+
+    TRACE_EXIT();
+}
+
+PwResult _mw_skip_value(MwParser* parser, unsigned key_indent)
+{
+    unsigned saved_block_indent;
+    PwValue status = _mw_start_nested_block(parser, key_indent + 1, &saved_block_indent);
+    pw_return_if_error(&status);
+
+    PwValue result = PwOK();
+    for (;;) {{
+        PwValue status = _mw_read_block_line(parser);
+        if (_mw_end_of_block(&status)) {
+            break;
+        }
+        if (pw_error(&status)) {
+            result = pw_move(&status);
+            break;
+        }
+    }}
+    _mw_end_nested_block(parser, saved_block_indent);
+    return pw_move(&result);
+}
+
+static PwResult skip_block(MwParser* parser)
+/*
+ * Read lines till the end of block without collecting them.
+ * Used in validation mode instead of _mw_read_block.
+ */
+{
+    for (;;) {{
+        PwValue status = _mw_read_block_line(parser);
+        if (_mw_end_of_block(&status)) {
+            return PwNull();
+        }
+        pw_return_if_error(&status);
+    }}
+}
+
+static PwResult parse_nested_block(MwParser* parser, unsigned block_pos, MwBlockParserFunc parser_func)
+/*
+ * Set block indent to `block_pos` and call parser_func.
+ */
+{
+    MW_TRACE_SPAN("parse_nested_block", parser->line_number);
+
+    unsigned saved_block_indent;
+    PwValue status = _mw_start_nested_block(parser, block_pos, &saved_block_indent);
+    pw_return_if_error(&status);
+
+    PwValue result = call_parser_func(parser, parser_func);
+
+    _mw_end_nested_block(parser, saved_block_indent);
+    return pw_move(&result);
+}
+
+static PwResult parse_nested_block_from_next_line(MwParser* parser, MwBlockParserFunc parser_func)
+/*
+ * Read next line, set block indent to current indent plus one, and call parser_func.
+ */
+{
+    MW_TRACE_SPAN("parse_nested_block", parser->line_number);
+
+    unsigned saved_block_indent;
+    PwValue status = _mw_start_nested_block_from_next_line(parser, &saved_block_indent);
+    pw_return_if_error(&status);
+
+    PwValue result = call_parser_func(parser, parser_func);
+
+    _mw_end_nested_block(parser, saved_block_indent);
+    return pw_move(&result);
 }
 
 unsigned _mw_get_start_position(MwParser* parser)
@@ -366,18 +826,46 @@ static PwResult parse_convspec(MwParser* parser, unsigned opening_colon_pos, uns
 
     pw_expect_true( pw_string_trim(&convspec) );
 
-    if (!have_custom_parser(parser, &convspec)) {
+    if (have_custom_parser(parser, &convspec)) {
+        pw_destroy(&parser->convspec_arg);
+        *end_pos = closing_colon_pos + 1;
+        return pw_move(&convspec);
+    }
+
+    // conversion specifier may have an argument separated by space
+    unsigned space_pos;
+    if (!pw_strchr(&convspec, ' ', 0, &space_pos)) {
         // such a conversion specifier is not defined
         return PwNull();
     }
+    PwValue name = pw_substr(&convspec, 0, space_pos);
+    pw_return_if_error(&name);
+
+    if (!have_custom_parser(parser, &name)) {
+        return PwNull();
+    }
+    if (!pw_map_has_key(&parser->convspecs_with_arg, &name)) {
+        return mw_parser_error(parser, opening_colon_pos, "Conversion specifier does not take an argument");
+    }
+    PwValue arg = pw_substr(&convspec, space_pos + 1, pw_strlen(&convspec));
+    pw_return_if_error(&arg);
+
+    pw_expect_true( pw_string_trim(&arg) );
+
+    pw_destroy(&parser->convspec_arg);
+    parser->convspec_arg = pw_move(&arg);
     *end_pos = closing_colon_pos + 1;
-    return pw_move(&convspec);
+    return pw_move(&name);
 }
 
 static PwResult parse_raw_value(MwParser* parser)
 {
     TRACEPOINT();
 
+    if (parser->validate_only) {
+        return skip_block(parser);
+    }
+
     PwValue lines = _mw_read_block(parser);
     pw_return_if_error(&lines);
 
@@ -397,6 +885,10 @@ static PwResult parse_literal_string(MwParser* parser)
 {
     TRACEPOINT();
 
+    if (parser->validate_only) {
+        return skip_block(parser);
+    }
+
     PwValue lines = _mw_read_block(parser);
     pw_return_if_error(&lines);
 
@@ -424,13 +916,150 @@ static PwResult parse_literal_string(MwParser* parser)
     return pw_array_join('\n', &lines);
 }
 
+uint8_t _mw_substr_char_size(PwValuePtr str, unsigned start_pos, unsigned end_pos)
+{
+    uint8_t str_char_size = pw_string_char_size(str);
+    if (str_char_size == 1) {
+        return 1;
+    }
+    uint8_t char_size = 1;
+    for (unsigned pos = start_pos; pos < end_pos; pos++) {
+        char32_t chr = pw_char_at(str, pos);
+        if (chr > 0xFFFF) {
+            // no narrower char size is possible
+            return str_char_size;
+        }
+        if (chr > 0xFF) {
+            char_size = 2;
+        }
+    }
+    return char_size;
+}
+
+char32_t _mw_decode_utf8(uint8_t** ptr, uint8_t* end)
+{
+    uint8_t* p = *ptr;
+    uint8_t c = *p++;
+    char32_t chr;
+    unsigned n;
+    if (c < 0x80) {
+        *ptr = p;
+        return c;
+    } else if ((c & 0xE0) == 0xC0) {
+        chr = c & 0x1F;
+        n = 1;
+    } else if ((c & 0xF0) == 0xE0) {
+        chr = c & 0x0F;
+        n = 2;
+    } else if ((c & 0xF8) == 0xF0) {
+        chr = c & 0x07;
+        n = 3;
+    } else {
+        *ptr = p;
+        return 0xFFFD;
+    }
+    while (n--) {
+        if (p == end || (*p & 0xC0) != 0x80) {
+            *ptr = p;
+            return 0xFFFD;
+        }
+        chr = (chr << 6) | (*p++ & 0x3F);
+    }
+    *ptr = p;
+    return chr;
+}
+
+PwResult _mw_create_string(char* data, size_t length)
+{
+    if (!memchr(data, 0, length)) {
+        return pw_create_string(data);
+    }
+    // find out length and char size first, so appending never reallocates or widens the string
+    uint8_t* p = (uint8_t*) data;
+    uint8_t* end = p + length;
+    unsigned num_chars = 0;
+    char32_t max_chr = 0;
+    while (p < end) {
+        char32_t chr = _mw_decode_utf8(&p, end);
+        if (chr > max_chr) {
+            max_chr = chr;
+        }
+        num_chars++;
+    }
+    uint8_t char_size = (max_chr > 0xFFFF)? 4 : (max_chr > 0xFF)? 2 : 1;
+
+    PwValue result = pw_create_empty_string(num_chars, char_size);
+    pw_return_if_error(&result);
+
+    p = (uint8_t*) data;
+    while (p < end) {
+        pw_expect_true( pw_string_append(&result, _mw_decode_utf8(&p, end)) );
+    }
+    return pw_move(&result);
+}
+
+unsigned _mw_value_end(PwValuePtr line, unsigned start_pos)
+{
+    unsigned end_pos = pw_strlen(line);
+    for (unsigned i = start_pos + 1; i < end_pos; i++) {
+        if (pw_char_at(line, i) == MW_COMMENT && pw_isspace(pw_char_at(line, i - 1))) {
+            end_pos = i;
+            break;
+        }
+    }
+    while (end_pos > start_pos && pw_isspace(pw_char_at(line, end_pos - 1))) {
+        end_pos--;
+    }
+    return end_pos;
+}
+
+PwResult _mw_substr(PwValuePtr str, unsigned start_pos, unsigned end_pos)
+{
+    unsigned length = pw_strlen(str);
+    if (end_pos > length) {
+        end_pos = length;
+    }
+    if (start_pos >= end_pos) {
+        return pw_create_empty_string(0, 1);
+    }
+    uint8_t char_size = _mw_substr_char_size(str, start_pos, end_pos);
+    if (char_size == pw_string_char_size(str)) {
+        return pw_substr(str, start_pos, end_pos);
+    }
+    PwValue result = pw_create_empty_string(end_pos - start_pos, char_size);
+    pw_return_if_error(&result);
+
+    for (unsigned pos = start_pos; pos < end_pos; pos++) {
+        pw_expect_true( pw_string_append(&result, pw_char_at(str, pos)) );
+    }
+    return pw_move(&result);
+}
+
+static inline bool append_unescaped(MwParser* parser, PwValuePtr result, char32_t chr)
+{
+    if (parser->validate_only) {
+        // nothing to append to
+        return true;
+    }
+    return pw_string_append(result, chr);
+}
+
 PwResult _mw_unescape_line(MwParser* parser, PwValuePtr line, unsigned line_number,
                             char32_t quote, unsigned start_pos, unsigned end_pos)
 {
-    PwValue result = pw_create_empty_string(
-        end_pos - start_pos,  // unescaped string can be shorter
-        pw_string_char_size(line)
-    );
+    // The line can be wide because of characters outside of the quoted string,
+    // e.g. a single emoji somewhere in a long line of minified JSON.
+    // Allocate result with char size of the quoted part only,
+    // escaped characters will widen it if necessary.
+    PwValue result = PwNull();
+    if (!parser->validate_only) {
+        result = pw_create_empty_string(
+            end_pos - start_pos,  // unescaped string can be shorter
+            _mw_substr_char_size(line, start_pos, end_pos)
+        );
+        pw_return_if_error(&result);
+    }
+
     unsigned pos = start_pos;
     while (pos < end_pos) {
         char32_t chr = pw_char_at(line, pos);
@@ -439,12 +1068,12 @@ PwResult _mw_unescape_line(MwParser* parser, PwValuePtr line, unsigned line_numb
             break;
         }
         if (chr != '\\') {
-            pw_expect_true( pw_string_append(&result, chr) );
+            pw_expect_true( append_unescaped(parser, &result, chr) );
         } else {
             // start of escape sequence
             pos++;
             if (pos >= end_pos) {
-                pw_return_ok_or_oom( pw_string_append(&result, chr) );  // leave backslash in the result
+                pw_return_ok_or_oom( append_unescaped(parser, &result, chr) );  // leave backslash in the result
             }
             bool append_ok = false;
             int hexlen;
@@ -456,15 +1085,15 @@ PwResult _mw_unescape_line(MwParser* parser, PwValuePtr line, unsigned line_numb
                 case '"':     //  \"   double quote     byte 0x22
                 case '?':     //  \?   question mark    byte 0x3f
                 case '\\':    //  \\   backslash        byte 0x5c
-                    append_ok = pw_string_append(&result, chr);
+                    append_ok = append_unescaped(parser, &result, chr);
                     break;
-                case 'a': append_ok = pw_string_append(&result, 0x07); break;  // audible bell
-                case 'b': append_ok = pw_string_append(&result, 0x08); break;  // backspace
-                case 'f': append_ok = pw_string_append(&result, 0x0c); break;  // form feed
-                case 'n': append_ok = pw_string_append(&result, 0x0a); break;  // line feed
-                case 'r': append_ok = pw_string_append(&result, 0x0d); break;  // carriage return
-                case 't': append_ok = pw_string_append(&result, 0x09); break;  // horizontal tab
-                case 'v': append_ok = pw_string_append(&result, 0x0b); break;  // vertical tab
+                case 'a': append_ok = append_unescaped(parser, &result, 0x07); break;  // audible bell
+                case 'b': append_ok = append_unescaped(parser, &result, 0x08); break;  // backspace
+                case 'f': append_ok = append_unescaped(parser, &result, 0x0c); break;  // form feed
+                case 'n': append_ok = append_unescaped(parser, &result, 0x0a); break;  // line feed
+                case 'r': append_ok = append_unescaped(parser, &result, 0x0d); break;  // carriage return
+                case 't': append_ok = append_unescaped(parser, &result, 0x09); break;  // horizontal tab
+                case 'v': append_ok = append_unescaped(parser, &result, 0x0b); break;  // vertical tab
 
                 // Numeric escape sequences
                 case 'o': {
@@ -486,7 +1115,7 @@ PwResult _mw_unescape_line(MwParser* parser, PwValuePtr line, unsigned line_numb
                             return mw_parser_error2(parser, line_number, pos, "Bad octal value");
                         }
                     }
-                    append_ok = pw_string_append(&result, v);
+                    append_ok = append_unescaped(parser, &result, v);
                     break;
                 }
                 case 'x':
@@ -524,14 +1153,14 @@ PwResult _mw_unescape_line(MwParser* parser, PwValuePtr line, unsigned line_numb
                             return mw_parser_error2(parser, line_number, pos, "Bad hexadecimal value");
                         }
                     }
-                    append_ok = pw_string_append(&result, v);
+                    append_ok = append_unescaped(parser, &result, v);
                     break;
                 }
                 default:
                     // not a valid escape sequence
-                    append_ok = pw_string_append(&result, '\\');
+                    append_ok = append_unescaped(parser, &result, '\\');
                     if (append_ok) {
-                        append_ok = pw_string_append(&result, chr);
+                        append_ok = append_unescaped(parser, &result, chr);
                     }
                     break;
             }
@@ -633,6 +1262,10 @@ static PwResult parse_folded_string(MwParser* parser)
 {
     TRACEPOINT();
 
+    if (parser->validate_only) {
+        return skip_block(parser);
+    }
+
     PwValue lines = _mw_read_block(parser);
     pw_return_if_error(&lines);
 
@@ -641,12 +1274,18 @@ static PwResult parse_folded_string(MwParser* parser)
 
 bool _mw_find_closing_quote(PwValuePtr line, char32_t quote, unsigned start_pos, unsigned* end_pos)
 {
+    unsigned string_start = start_pos;
     for (;;) {
         if (!pw_strchr(line, quote, start_pos, end_pos)) {
             return false;
         }
-        // check if the quotation mark is not escaped
-        if (*end_pos && pw_char_at(line, *end_pos - 1) == '\\') {
+        // the quotation mark is escaped if preceded by odd number of backslashes,
+        // e.g. "C:\\dir\\" ends with escaped backslash, not with escaped quote
+        unsigned num_backslashes = 0;
+        for (unsigned i = *end_pos; i > string_start && pw_char_at(line, i - 1) == '\\'; i--) {
+            num_backslashes++;
+        }
+        if (num_backslashes & 1) {
             // continue searching
             start_pos = *end_pos + 1;
         } else {
@@ -684,32 +1323,58 @@ static PwResult parse_quoted_string(MwParser* parser, unsigned opening_quote_pos
     parser->blocklevel++;
 
     // read block
-    PwValue lines = PwArray();
-    pw_return_if_error(&lines);
-
-    PwValue line_numbers = PwArray();
-    pw_return_if_error(&line_numbers);
+    PwValue lines = PwNull();
+    PwValue line_numbers = PwNull();
+    if (!parser->validate_only) {
+        lines = PwArray();
+        pw_return_if_error(&lines);
+
+        line_numbers = PwArray();
+        pw_return_if_error(&line_numbers);
+    }
 
     bool closing_quote_detected = false;
+    size_t total_length = 0;
     for (;;) {{
-        // append line number
-        PwValue n = PwUnsigned(parser->line_number);
-        pw_expect_ok( pw_array_append(&line_numbers, &n) );
-
-        // append line
-        if (_mw_find_closing_quote(&parser->current_line, quote, block_indent, end_pos)) {
-            // final line
-            PwValue final_line = pw_substr(&parser->current_line, block_indent, *end_pos);
-            pw_expect_true( pw_string_rtrim(&final_line) );
-            pw_expect_ok( pw_array_append(&lines, &final_line) );
-            (*end_pos)++;
-            closing_quote_detected = true;
-            break;
+        unsigned length = pw_strlen(&parser->current_line);
+        unsigned line_length = (length > block_indent)? length - block_indent : 0;
+        total_length += line_length + 1;
+        PwValue limit = count_string(parser, total_length, line_length);
+        pw_return_if_error(&limit);
+
+        if (parser->validate_only) {
+            // check escape sequences instead of collecting lines
+            bool final_line = _mw_find_closing_quote(&parser->current_line, quote, block_indent, end_pos);
+            unsigned line_end = final_line? *end_pos : pw_strlen(&parser->current_line);
+            PwValue status = _mw_unescape_line(parser, &parser->current_line, parser->line_number,
+                                               quote, block_indent, line_end);
+            pw_return_if_error(&status);
+            if (final_line) {
+                (*end_pos)++;
+                closing_quote_detected = true;
+                break;
+            }
         } else {
-            // intermediate line
-            PwValue line = pw_substr(&parser->current_line, block_indent, UINT_MAX);
-            pw_return_if_error(&line);
-            pw_expect_ok( pw_array_append(&lines, &line) );
+            // append line number
+            PwValue n = PwUnsigned(parser->line_number);
+            pw_expect_ok( pw_array_append(&line_numbers, &n) );
+
+            // append line
+            if (_mw_find_closing_quote(&parser->current_line, quote, block_indent, end_pos)) {
+                // final line
+                PwValue final_line = _mw_substr(&parser->current_line, block_indent, *end_pos);
+                pw_return_if_error(&final_line);
+                pw_expect_true( pw_string_rtrim(&final_line) );
+                pw_expect_ok( pw_array_append(&lines, &final_line) );
+                (*end_pos)++;
+                closing_quote_detected = true;
+                break;
+            } else {
+                // intermediate line
+                PwValue line = _mw_substr(&parser->current_line, block_indent, UINT_MAX);
+                pw_return_if_error(&line);
+                pw_expect_ok( pw_array_append(&lines, &line) );
+            }
         }
         // read next line
         PwValue status = _mw_read_block_line(parser);
@@ -742,6 +1407,10 @@ static PwResult parse_quoted_string(MwParser* parser, unsigned opening_quote_pos
         }
     }
 
+    if (parser->validate_only) {
+        return PwNull();
+    }
+
     // fold and unescape
 
     return fold_lines(parser, &lines, quote, &line_numbers);
@@ -800,6 +1469,198 @@ static PwResult parse_timestamp(MwParser* parser)
     }
 }
 
+#define BASE64_PADDING  64
+#define BASE64_SPACE    65
+#define BASE64_INVALID  66
+
+static uint8_t base64_table[128];
+
+[[ gnu::constructor ]]
+static void init_base64_table()
+{
+    static char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    memset(base64_table, BASE64_INVALID, sizeof(base64_table));
+    for (uint8_t i = 0; i < 64; i++) {
+        base64_table[(uint8_t) alphabet[i]] = i;
+    }
+    // URL-safe alphabet
+    base64_table['-'] = 62;
+    base64_table['_'] = 63;
+
+    base64_table['='] = BASE64_PADDING;
+    base64_table[' '] = BASE64_SPACE;
+    base64_table['\t'] = BASE64_SPACE;
+}
+
+static bool flush_base64(PwValuePtr result, uint8_t* chunk, unsigned* chunk_len)
+/*
+ * Append decoded bytes to the result string of char size 1.
+ */
+{
+    if (*chunk_len == 0) {
+        return true;
+    }
+    bool ok = pw_string_append_buffer(result, chunk, *chunk_len);
+    *chunk_len = 0;
+    return ok;
+}
+
+static PwResult parse_base64(MwParser* parser)
+/*
+ * Decode block as base64 directly from block lines.
+ *
+ * Return string of char size 1 that contains one character per decoded byte.
+ */
+{
+    TRACEPOINT();
+
+    static char bad_base64[] = "Bad base64 data";
+
+    PwValue result = PwNull();
+    if (!parser->validate_only) {
+        // decoded size of the first line is a reasonable guess
+        result = pw_create_empty_string(pw_strlen(&parser->current_line) * 3 / 4, 1);
+        pw_return_if_error(&result);
+    }
+
+    // decoded bytes are collected here and appended to the result in bulk
+    uint8_t chunk[768];
+    unsigned chunk_len = 0;
+
+    uint32_t group = 0;      // bits of incomplete group of four characters
+    unsigned group_len = 0;  // number of characters in the group
+    unsigned padding = 0;
+
+    // where the incomplete group starts, for error reporting
+    unsigned group_line_number = parser->line_number;
+    unsigned group_pos = 0;
+
+    MwBlockReader reader;
+    mw_block_reader_init(&reader, parser);
+    for (;;) {{
+        MwBlockLine line;
+        PwValue status = mw_block_reader_next(&reader, &line);
+        if (_mw_end_of_block(&status)) {
+            break;
+        }
+        pw_return_if_error(&status);
+
+        for (unsigned pos = line.start; pos < line.end; pos++) {
+            char32_t chr = pw_char_at(line.line, pos);
+            uint8_t v = (chr < 128)? base64_table[chr] : BASE64_INVALID;
+            if (v < 64 && !padding) {
+                if (group_len == 0) {
+                    group_line_number = line.line_number;
+                    group_pos = pos;
+                }
+                group = (group << 6) | v;
+                if (++group_len < 4) {
+                    continue;
+                }
+                if (!parser->validate_only) {
+                    chunk[chunk_len++] = (uint8_t) (group >> 16);
+                    chunk[chunk_len++] = (uint8_t) (group >> 8);
+                    chunk[chunk_len++] = (uint8_t) group;
+                    // keep room for the next group
+                    if (chunk_len + 3 > sizeof(chunk) && !flush_base64(&result, chunk, &chunk_len)) {
+                        return PwOOM();
+                    }
+                }
+                group = 0;
+                group_len = 0;
+            } else if (v == BASE64_SPACE) {
+                continue;
+            } else if (v == BASE64_PADDING && group_len >= 2 && group_len + padding < 4) {
+                padding++;
+            } else {
+                return mw_parser_error2(parser, line.line_number, pos, bad_base64);
+            }
+        }
+    }}
+
+    // decode incomplete group; padding, if present, must complete it
+    if (group_len == 1 || (padding && group_len + padding != 4)) {
+        return mw_parser_error2(parser, group_line_number, group_pos, bad_base64);
+    }
+    if (!parser->validate_only) {
+        // the chunk has room for at least three bytes after the last full group
+        if (group_len == 2) {
+            chunk[chunk_len++] = (uint8_t) (group >> 4);
+        } else if (group_len == 3) {
+            chunk[chunk_len++] = (uint8_t) (group >> 10);
+            chunk[chunk_len++] = (uint8_t) (group >> 2);
+        }
+        if (!flush_base64(&result, chunk, &chunk_len)) {
+            return PwOOM();
+        }
+    }
+    return pw_move(&result);
+}
+
+static PwResult parse_anchor(MwParser* parser)
+/*
+ * Parse block as a value and save it under the name given
+ * in conversion specifier argument for subsequent references.
+ */
+{
+    TRACEPOINT();
+
+    PwValue name = pw_move(&parser->convspec_arg);
+    if (!pw_is_string(&name) || pw_strlen(&name) == 0) {
+        return mw_parser_error(parser, parser->current_indent, "Anchor name expected");
+    }
+    unsigned line_number = parser->line_number;
+    unsigned position = _mw_get_start_position(parser);
+
+    PwValue value = value_parser_func(parser);
+    pw_return_if_error(&value);
+
+    if (parser->event_handler && parser->value_emitted) {
+        // list or map was passed to event handler and there's nothing to save
+        return mw_parser_error2(parser, line_number, position,
+                                "Anchored lists and maps are not supported with event handler");
+    }
+    if (pw_is_null(&parser->anchors)) {
+        parser->anchors = PwMap();
+        pw_return_if_error(&parser->anchors);
+    }
+    // in validation mode value is null, but the name is still needed to check references
+    PwValue anchored = pw_clone(&value);
+    pw_expect_ok( pw_map_update(&parser->anchors, &name, &anchored) );
+
+    return pw_move(&value);
+}
+
+static PwResult parse_ref(MwParser* parser)
+/*
+ * Return value saved by :anchor: conversion specifier.
+ * The block contains anchor name.
+ *
+ * The value is shared, not copied.
+ */
+{
+    TRACEPOINT();
+
+    unsigned line_number = parser->line_number;
+    unsigned start_pos = _mw_get_start_position(parser);
+    unsigned end_pos = _mw_value_end(&parser->current_line, start_pos);
+
+    PwValue name = _mw_substr(&parser->current_line, start_pos, end_pos);
+    pw_return_if_error(&name);
+
+    // make sure current block has no more data
+    PwValue status = _mw_read_block_line(parser);
+    if (!_mw_end_of_block(&status)) {
+        pw_return_if_error(&status);
+        return mw_parser_error(parser, parser->current_indent, "Anchor name must be a single line");
+    }
+    if (pw_is_null(&parser->anchors) || !pw_map_has_key(&parser->anchors, &name)) {
+        return mw_parser_error2(parser, line_number, start_pos, "Unknown anchor");
+    }
+    return pw_map_get(&parser->anchors, &name);
+}
+
 PwResult _mw_parse_number(MwParser* parser, unsigned start_pos, int sign, unsigned* end_pos, char32_t* allowed_terminators)
 {
     TRACEPOINT();
@@ -817,6 +1678,28 @@ PwResult _mw_parse_number(MwParser* parser, unsigned start_pos, int sign, unsign
     return pw_move(&result);
 }
 
+static inline bool build_containers(MwParser* parser)
+/*
+ * Return false if lists and maps are not collected,
+ * either in validation mode or when events are emitted instead.
+ */
+{
+    return !parser->validate_only && !parser->event_handler;
+}
+
+static PwResult emit_value(MwParser* parser, PwValuePtr value)
+/*
+ * Pass value to event handler unless it was a list or map
+ * which emitted its own events.
+ */
+{
+    if (!parser->event_handler || parser->value_emitted) {
+        return PwOK();
+    }
+    parser->value_emitted = true;
+    return parser->event_handler->value(parser->event_handler, value);
+}
+
 static PwResult parse_list(MwParser* parser)
 /*
  * Parse list.
@@ -826,9 +1709,20 @@ static PwResult parse_list(MwParser* parser)
  */
 {
     TRACE_ENTER();
+    MW_TRACE_SPAN("parse_list", parser->line_number);
 
-    PwValue result = PwArray();
-    pw_return_if_error(&result);
+    PwValue result = PwNull();
+    if (build_containers(parser)) {
+        result = PwArray();
+        pw_return_if_error(&result);
+    }
+    if (parser->event_handler) {
+        PwValue status = parser->event_handler->start_list(parser->event_handler);
+        pw_return_if_error(&status);
+
+        // lists are counted by _mw_count_value unless passed to event handler
+        _mw_count_container(parser, MW_STATS_LIST);
+    }
 
     /*
      * All list items must have the same indent.
@@ -844,9 +1738,13 @@ static PwResult parse_list(MwParser* parser)
                 return mw_parser_error(parser, item_indent, "Bad list item");
             }
 
+            PwValue status = _mw_count_node(parser);
+            pw_return_if_error(&status);
+
             // parse item as a nested block
 
             PwValue item = PwNull();
+            parser->value_emitted = false;
             if (_mw_comment_or_end_of_line(parser, next_pos)) {
                 item = parse_nested_block_from_next_line(parser, value_parser_func);
             } else {
@@ -856,9 +1754,15 @@ static PwResult parse_list(MwParser* parser)
             }
             pw_return_if_error(&item);
 
-            pw_expect_ok( pw_array_append(&result, &item) );
+            _mw_count_value(parser, &item);
+            if (build_containers(parser)) {
+                pw_expect_ok( pw_array_append(&result, &item) );
+            } else {
+                PwValue status = emit_value(parser, &item);
+                pw_return_if_error(&status);
+            }
 
-            PwValue status = _mw_read_block_line(parser);
+            status = _mw_read_block_line(parser);
             if (_mw_end_of_block(&status)) {
                 break;
             }
@@ -869,6 +1773,11 @@ static PwResult parse_list(MwParser* parser)
             }
         }
     }
+    if (parser->event_handler) {
+        PwValue status = parser->event_handler->end_list(parser->event_handler);
+        pw_return_if_error(&status);
+        parser->value_emitted = true;
+    }
     TRACE_EXIT();
     return pw_move(&result);
 }
@@ -884,9 +1793,19 @@ static PwResult parse_map(MwParser* parser, PwValuePtr first_key, PwValuePtr con
  */
 {
     TRACE_ENTER();
+    MW_TRACE_SPAN("parse_map", parser->line_number);
 
-    PwValue result = PwMap();
-    pw_return_if_error(&result);
+    PwValue result = PwNull();
+    if (build_containers(parser)) {
+        result = PwMap();
+        pw_return_if_error(&result);
+    }
+    if (parser->event_handler) {
+        PwValue status = parser->event_handler->start_map(parser->event_handler);
+        pw_return_if_error(&status);
+
+        _mw_count_container(parser, MW_STATS_MAP);
+    }
 
     PwValue key = pw_clone(first_key);
     PwValue convspec = pw_clone(convspec_arg);
@@ -900,13 +1819,21 @@ static PwResult parse_map(MwParser* parser, PwValuePtr first_key, PwValuePtr con
     for (;;) {
         TRACE("parse value (line %u) from position %u", parser->line_number, value_pos);
         {
+            PwValue status = _mw_count_node(parser);
+            pw_return_if_error(&status);
+
             // parse value as a nested block
 
             MwBlockParserFunc parser_func = value_parser_func;
             if (pw_is_string(&convspec)) {
                 parser_func = get_custom_parser(parser, &convspec);
             }
+            if (parser->event_handler) {
+                PwValue status = parser->event_handler->key(parser->event_handler, &key);
+                pw_return_if_error(&status);
+            }
             PwValue value = PwNull();
+            parser->value_emitted = false;
             if (_mw_comment_or_end_of_line(parser, value_pos)) {
                 value = parse_nested_block_from_next_line(parser, parser_func);
 
@@ -915,7 +1842,13 @@ static PwResult parse_map(MwParser* parser, PwValuePtr first_key, PwValuePtr con
             }
             pw_return_if_error(&value);
 
-            pw_expect_ok( pw_map_update(&result, &key, &value) );
+            _mw_count_value(parser, &value);
+            if (build_containers(parser)) {
+                pw_expect_ok( pw_map_update(&result, &key, &value) );
+            } else {
+                PwValue status = emit_value(parser, &value);
+                pw_return_if_error(&status);
+            }
         }
         TRACE("parse next key");
         {
@@ -937,6 +1870,11 @@ static PwResult parse_map(MwParser* parser, PwValuePtr first_key, PwValuePtr con
             pw_return_if_error(&key);
         }
     }
+    if (parser->event_handler) {
+        PwValue status = parser->event_handler->end_map(parser->event_handler);
+        pw_return_if_error(&status);
+        parser->value_emitted = true;
+    }
     TRACE_EXIT();
     return pw_move(&result);
 }
@@ -1111,8 +2049,7 @@ static PwResult parse_value(MwParser* parser, unsigned* nested_value_pos, PwValu
             pw_return_if_error(&status);
 
             // call parser function
-            MwBlockParserFunc parser_func = get_custom_parser(parser, &convspec);
-            return parser_func(parser);
+            return call_parser_func(parser, get_custom_parser(parser, &convspec));
 
         } else {
             // value is on the same line, parse it as nested block
@@ -1217,11 +2154,14 @@ parse_literal_string_or_map:
 
         if (kvs.bool_value) {
             // found key-value separator, get key
-            PwValue key = pw_substr(&parser->current_line, start_pos, colon_pos);
-            pw_return_if_error(&key);
+            PwValue key = PwNull();
+            if (!parser->validate_only) {
+                key = _mw_substr(&parser->current_line, start_pos, colon_pos);
+                pw_return_if_error(&key);
 
-            // strip trailing spaces
-            pw_expect_true( pw_string_rtrim(&key) );
+                // strip trailing spaces
+                pw_expect_true( pw_string_rtrim(&key) );
+            }
 
             if (nested_value_pos) {
                 // key was anticipated, simply return it
@@ -1250,12 +2190,73 @@ static PwResult value_parser_func(MwParser* parser)
     return parse_value(parser, nullptr, nullptr);
 }
 
-PwResult mw_parse(PwValuePtr markup)
+PwResult _mw_parse_value(MwParser* parser, unsigned* nested_value_pos, PwValuePtr convspec_out)
 {
-    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
-    if (!parser) {
-        return PwOOM();
+    return parse_value(parser, nested_value_pos, convspec_out);
+}
+
+PwResult _mw_parse_key(MwParser* parser, unsigned* key_start, unsigned* key_end,
+                       unsigned* value_pos, PwValuePtr convspec_out)
+{
+    PwValuePtr current_line = &parser->current_line;
+
+    unsigned start_pos = _mw_get_start_position(parser);
+    char32_t chr = pw_char_at(current_line, start_pos);
+
+    if (chr == ':') {
+        return mw_parser_error(parser, start_pos, "Map key expected and it cannot start with colon");
+    }
+    if (chr == '"' || chr == '\'') {
+        // quoted key, escape sequences are not processed
+        unsigned closing_quote_pos;
+        if (!_mw_find_closing_quote(current_line, chr, start_pos + 1, &closing_quote_pos)) {
+            return mw_parser_error(parser, start_pos, "String has no closing quote");
+        }
+        unsigned colon_pos = pw_string_skip_spaces(current_line, closing_quote_pos + 1);
+        if (end_of_line(current_line, colon_pos) || pw_char_at(current_line, colon_pos) != ':') {
+            return mw_parser_error(parser, colon_pos, "Map key expected");
+        }
+        PwValue kvs = is_kv_separator(parser, colon_pos, convspec_out, value_pos);
+        pw_return_if_error(&kvs);
+
+        if (!kvs.bool_value) {
+            return mw_parser_error(parser, colon_pos + 1, "Bad character encountered");
+        }
+        *key_start = start_pos + 1;
+        *key_end = closing_quote_pos;
+        return PwOK();
+    }
+
+    // look for key-value separator
+    for (unsigned pos = start_pos;;) {
+        unsigned colon_pos;
+        if (!pw_strchr(current_line, ':', pos, &colon_pos)) {
+            break;
+        }
+        PwValue kvs = is_kv_separator(parser, colon_pos, convspec_out, value_pos);
+        pw_return_if_error(&kvs);
+
+        if (kvs.bool_value) {
+            // strip trailing spaces
+            while (colon_pos > start_pos && pw_isspace(pw_char_at(current_line, colon_pos - 1))) {
+                colon_pos--;
+            }
+            *key_start = start_pos;
+            *key_end = colon_pos;
+            return PwOK();
+        }
+        pos = colon_pos + 1;
     }
+    return mw_parser_error(parser, parser->current_indent, "Not a key");
+}
+
+MwBlockParserFunc _mw_get_custom_parser(MwParser* parser, PwValuePtr convspec)
+{
+    return get_custom_parser(parser, convspec);
+}
+
+PwResult mw_parser_parse(MwParser* parser)
+{
     // read first line to prepare for parsing and to detect EOF
     PwValue status = _mw_read_block_line(parser);
     if (_mw_end_of_block(&status) && parser->eof) {
@@ -1264,9 +2265,14 @@ PwResult mw_parse(PwValuePtr markup)
     pw_return_if_error(&status);
 
     // parse top-level value
+    parser->value_emitted = false;
     PwValue result = value_parser_func(parser);
     pw_return_if_error(&result);
 
+    _mw_count_value(parser, &result);
+    status = emit_value(parser, &result);
+    pw_return_if_error(&status);
+
     // make sure markup has no more data
     status = _mw_read_block_line(parser);
     if (parser->eof) {
@@ -1277,3 +2283,25 @@ PwResult mw_parse(PwValuePtr markup)
     }
     return pw_move(&result);
 }
+
+PwResult mw_parse(PwValuePtr markup)
+{
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
+    if (!parser) {
+        return PwOOM();
+    }
+    return mw_parser_parse(parser);
+}
+
+PwResult mw_validate(PwValuePtr markup)
+{
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
+    if (!parser) {
+        return PwOOM();
+    }
+    parser->validate_only = true;
+
+    PwValue result = mw_parser_parse(parser);
+    pw_return_if_error(&result);
+    return PwOK();
+}
@@ -0,0 +1,433 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <myaw.h>
+
+/*
+ * Read-ahead line reader.
+ *
+ * The producer thread reads the file into a ring of `queue_depth` chunks
+ * while the parser consumes lines from the chunks already filled.
+ * Lines are collected from chunks as UTF-8 bytes and decoded
+ * into the parser's current line.
+ *
+ * Long lines can be read in parts. Incomplete UTF-8 sequence
+ * at the end of a part is carried over to the next one.
+ */
+
+#define READAHEAD_ALIGNMENT  4096
+
+typedef struct {
+    char*  data;
+    size_t length;
+    int    error;  // errno
+    bool   eof;
+} Chunk;
+
+typedef struct {
+    MwLineReader base;
+
+    int      fd;
+    size_t   chunk_size;
+    unsigned queue_depth;
+    Chunk*   chunks;
+
+    // ring state, protected by mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+    unsigned head;   // chunk being consumed
+    unsigned tail;   // chunk being filled
+    unsigned count;  // number of filled chunks
+    bool     stop;
+
+    pthread_t thread;
+    bool      thread_started;
+
+    // consumer state
+    Chunk*   current;   // acquired chunk
+    size_t   position;  // in current chunk
+    bool     finished;  // last chunk was consumed
+    char*    line;      // bytes of last line
+    size_t   line_length;
+    size_t   line_capacity;
+    bool     unread;
+    bool     continues;  // last part did not end the line
+    bool     split;      // last line was read in parts and cannot be pushed back
+    char     carry[4];   // incomplete UTF-8 sequence of the last part
+    unsigned carry_length;
+    unsigned line_number;
+} Readahead;
+
+static void fill_chunk(Readahead* ra, Chunk* chunk)
+{
+    chunk->length = 0;
+    chunk->error = 0;
+    chunk->eof = false;
+    while (chunk->length < ra->chunk_size) {
+        ssize_t n = read(ra->fd, chunk->data + chunk->length, ra->chunk_size - chunk->length);
+        if (n == 0) {
+            chunk->eof = true;
+            return;
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            chunk->error = errno;
+            return;
+        }
+        chunk->length += n;
+    }
+}
+
+static void* producer_thread(void* arg)
+{
+    Readahead* ra = arg;
+    for (;;) {
+        pthread_mutex_lock(&ra->mutex);
+        while (ra->count == ra->queue_depth && !ra->stop) {
+            pthread_cond_wait(&ra->not_full, &ra->mutex);
+        }
+        if (ra->stop) {
+            pthread_mutex_unlock(&ra->mutex);
+            break;
+        }
+        Chunk* chunk = &ra->chunks[ra->tail];
+        pthread_mutex_unlock(&ra->mutex);
+
+        // the consumer does not touch chunks beyond `count`, fill without lock
+        fill_chunk(ra, chunk);
+
+        pthread_mutex_lock(&ra->mutex);
+        ra->tail = (ra->tail + 1) % ra->queue_depth;
+        ra->count++;
+        pthread_cond_signal(&ra->not_empty);
+        pthread_mutex_unlock(&ra->mutex);
+
+        if (chunk->eof || chunk->error) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+static void acquire_chunk(Readahead* ra)
+{
+    pthread_mutex_lock(&ra->mutex);
+    while (ra->count == 0) {
+        pthread_cond_wait(&ra->not_empty, &ra->mutex);
+    }
+    ra->current = &ra->chunks[ra->head];
+    pthread_mutex_unlock(&ra->mutex);
+    ra->position = 0;
+}
+
+static void release_chunk(Readahead* ra)
+{
+    pthread_mutex_lock(&ra->mutex);
+    ra->head = (ra->head + 1) % ra->queue_depth;
+    ra->count--;
+    pthread_cond_signal(&ra->not_full);
+    pthread_mutex_unlock(&ra->mutex);
+    ra->current = nullptr;
+}
+
+static bool append_bytes(Readahead* ra, char* data, size_t length)
+{
+    size_t required = ra->line_length + length;
+    if (required > ra->line_capacity) {
+        size_t capacity = ra->line_capacity? ra->line_capacity : 256;
+        while (capacity < required) {
+            capacity *= 2;
+        }
+        char* line = realloc(ra->line, capacity);
+        if (!line) {
+            return false;
+        }
+        ra->line = line;
+        ra->line_capacity = capacity;
+    }
+    memcpy(ra->line + ra->line_length, data, length);
+    ra->line_length = required;
+    return true;
+}
+
+static PwResult decode_line(Readahead* ra, PwValuePtr line)
+{
+    pw_string_truncate(line, 0);
+
+    uint8_t* p = (uint8_t*) ra->line;
+    uint8_t* end = p + ra->line_length;
+    while (p < end) {
+        if (!pw_string_append(line, _mw_decode_utf8(&p, end))) {
+            return PwOOM();
+        }
+    }
+    return PwOK();
+}
+
+static void carry_incomplete_sequence(Readahead* ra)
+/*
+ * Move incomplete UTF-8 sequence at the end of the line buffer to `carry`.
+ */
+{
+    size_t end = ra->line_length;
+    unsigned n = 0;
+    while (n < 3 && n < end && (ra->line[end - n - 1] & 0xC0) == 0x80) {
+        n++;
+    }
+    if (n == end) {
+        return;
+    }
+    uint8_t lead = ra->line[end - n - 1];
+    unsigned sequence_length = (lead >= 0xF0)? 4 : (lead >= 0xE0)? 3 : (lead >= 0xC0)? 2 : 1;
+    if (sequence_length > n + 1) {
+        ra->carry_length = n + 1;
+        ra->line_length -= ra->carry_length;
+        memcpy(ra->carry, ra->line + ra->line_length, ra->carry_length);
+    }
+}
+
+static PwResult collect_line(Readahead* ra, size_t max_length, bool* line_continues)
+/*
+ * Collect the line, or at most `max_length` bytes of it, into the line buffer.
+ */
+{
+    ra->line_length = 0;
+    bool have_line = ra->continues;
+    if (ra->carry_length) {
+        if (!append_bytes(ra, ra->carry, ra->carry_length)) {
+            return PwOOM();
+        }
+        ra->carry_length = 0;
+    }
+    *line_continues = false;
+    for (;;) {
+        if (!ra->current) {
+            if (ra->finished) {
+                break;
+            }
+            acquire_chunk(ra);
+        }
+        Chunk* chunk = ra->current;
+        char* start = chunk->data + ra->position;
+        size_t available = chunk->length - ra->position;
+        char* newline = memchr(start, '\n', available);
+        size_t length = newline? (size_t) (newline - start) : available;
+        if (length > max_length - ra->line_length) {
+            length = max_length - ra->line_length;
+            newline = nullptr;
+            *line_continues = true;
+        }
+
+        if (!append_bytes(ra, start, length)) {
+            return PwOOM();
+        }
+        if (length) {
+            have_line = true;
+        }
+        ra->position += length;
+        if (*line_continues) {
+            carry_incomplete_sequence(ra);
+            break;
+        }
+        if (newline) {
+            ra->position++;
+            have_line = true;
+            break;
+        }
+        // chunk is exhausted
+        int error = chunk->error;
+        bool eof = chunk->eof;
+        release_chunk(ra);
+        if (error) {
+            ra->finished = true;
+            return PwErrno(error);
+        }
+        if (eof) {
+            ra->finished = true;
+        }
+    }
+    if (!have_line) {
+        return PwError(PW_ERROR_EOF);
+    }
+    // parts of the same line share its number
+    if (!ra->continues) {
+        ra->line_number++;
+    }
+    ra->split = ra->continues || *line_continues;
+    ra->continues = *line_continues;
+    return PwOK();
+}
+
+static PwResult readahead_read_line(MwLineReader* reader, PwValuePtr line)
+{
+    Readahead* ra = (Readahead*) reader;
+
+    if (ra->unread) {
+        ra->unread = false;
+        ra->line_number++;
+        return decode_line(ra, line);
+    }
+    bool line_continues;
+    PwValue status = collect_line(ra, SIZE_MAX, &line_continues);
+    pw_return_if_error(&status);
+
+    return decode_line(ra, line);
+}
+
+static PwResult readahead_read_line_part(MwLineReader* reader, PwValuePtr line,
+                                         size_t max_length, bool* line_continues)
+{
+    Readahead* ra = (Readahead*) reader;
+
+    if (ra->unread) {
+        ra->unread = false;
+        ra->line_number++;
+        *line_continues = false;
+        return decode_line(ra, line);
+    }
+    // make room for carried over bytes
+    if (max_length < sizeof(ra->carry) * 2) {
+        max_length = sizeof(ra->carry) * 2;
+    }
+    PwValue status = collect_line(ra, max_length, line_continues);
+    pw_return_if_error(&status);
+
+    return decode_line(ra, line);
+}
+
+static bool readahead_unread_line(MwLineReader* reader, PwValuePtr line)
+{
+    Readahead* ra = (Readahead*) reader;
+    if (ra->unread || ra->split) {
+        return false;
+    }
+    // the line is still in the buffer
+    ra->unread = true;
+    ra->line_number--;
+    return true;
+}
+
+static unsigned readahead_line_number(MwLineReader* reader)
+{
+    return ((Readahead*) reader)->line_number;
+}
+
+PwResult mw_open_readahead(char* path, size_t chunk_size, unsigned queue_depth, MwLineReader** result)
+{
+    if (chunk_size == 0) {
+        chunk_size = MW_READAHEAD_CHUNK_SIZE;
+    }
+    // aligned chunks make reads of whole pages
+    chunk_size = (chunk_size + READAHEAD_ALIGNMENT - 1) & ~(size_t) (READAHEAD_ALIGNMENT - 1);
+
+    if (queue_depth == 0) {
+        queue_depth = MW_READAHEAD_QUEUE_DEPTH;
+    } else if (queue_depth < 2) {
+        // at least one chunk is filled while another one is consumed
+        queue_depth = 2;
+    }
+
+    Readahead* ra = allocate(sizeof(Readahead), true);
+    if (!ra) {
+        return PwOOM();
+    }
+    ra->base.read_line   = readahead_read_line;
+    ra->base.unread_line = readahead_unread_line;
+    ra->base.line_number = readahead_line_number;
+    ra->base.read_line_part = readahead_read_line_part;
+    ra->fd = -1;
+    ra->chunk_size  = chunk_size;
+    ra->queue_depth = queue_depth;
+    pthread_mutex_init(&ra->mutex, nullptr);
+    pthread_cond_init(&ra->not_empty, nullptr);
+    pthread_cond_init(&ra->not_full, nullptr);
+
+    MwLineReader* reader = &ra->base;
+    PwValue status = PwOK();
+
+    ra->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (ra->fd == -1) {
+        status = PwErrno(errno);
+        goto error;
+    }
+    posix_fadvise(ra->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    ra->chunks = allocate(sizeof(Chunk) * queue_depth, true);
+    if (!ra->chunks) {
+        status = PwOOM();
+        goto error;
+    }
+    for (unsigned i = 0; i < queue_depth; i++) {
+        ra->chunks[i].data = aligned_alloc(READAHEAD_ALIGNMENT, chunk_size);
+        if (!ra->chunks[i].data) {
+            status = PwOOM();
+            goto error;
+        }
+    }
+    int err = pthread_create(&ra->thread, nullptr, producer_thread, ra);
+    if (err) {
+        status = PwErrno(err);
+        goto error;
+    }
+    ra->thread_started = true;
+
+    *result = reader;
+    return PwOK();
+
+error:
+    mw_close_readahead(&reader);
+    return pw_move(&status);
+}
+
+void mw_close_readahead(MwLineReader** reader_ptr)
+{
+    Readahead* ra = (Readahead*) *reader_ptr;
+    *reader_ptr = nullptr;
+    if (!ra) {
+        return;
+    }
+    if (ra->thread_started) {
+        pthread_mutex_lock(&ra->mutex);
+        ra->stop = true;
+        pthread_cond_signal(&ra->not_full);
+        pthread_mutex_unlock(&ra->mutex);
+        pthread_join(ra->thread, nullptr);
+    }
+    if (ra->chunks) {
+        for (unsigned i = 0; i < ra->queue_depth; i++) {
+            free(ra->chunks[i].data);
+        }
+        release((void**) &ra->chunks, sizeof(Chunk) * ra->queue_depth);
+    }
+    if (ra->fd != -1) {
+        close(ra->fd);
+    }
+    free(ra->line);
+    pthread_cond_destroy(&ra->not_full);
+    pthread_cond_destroy(&ra->not_empty);
+    pthread_mutex_destroy(&ra->mutex);
+    release((void**) &ra, sizeof(Readahead));
+}
+
+PwResult mw_parse_file_readahead(char* path, size_t chunk_size, unsigned queue_depth)
+{
+    [[ gnu::cleanup(mw_close_readahead) ]] MwLineReader* reader = nullptr;
+    PwValue status = mw_open_readahead(path, chunk_size, queue_depth, &reader);
+    pw_return_if_error(&status);
+
+    PwValue markup = PwNull();
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(&markup);
+    if (!parser) {
+        return PwOOM();
+    }
+    parser->line_reader = reader;
+    return mw_parser_parse(parser);
+}
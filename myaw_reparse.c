@@ -0,0 +1,179 @@
+#include <limits.h>
+
+#include <myaw.h>
+
+/*
+ * Incremental reparse.
+ *
+ * Top-level map entries are blocks that start from a line with zero indent.
+ * All subsequent lines that are indented, empty, or comments belong to the same block.
+ * Unchanged blocks are detected by text and their values are reused
+ * from the previous tree. Changed blocks are parsed individually.
+ *
+ * Blocks are not independent if the text uses anchors, references, or includes,
+ * such texts are always parsed as a whole.
+ */
+
+static bool has_dependencies(PwValuePtr text)
+/*
+ * Check if `text` may contain conversion specifiers that make blocks depend
+ * on each other or on external files. False positives only cost a full parse.
+ */
+{
+    unsigned text_len = pw_strlen(text);
+    unsigned pos = 0;
+    unsigned colon_pos;
+    while (pw_strchr(text, ':', pos, &colon_pos)) {
+        if (pw_substring_eq(text, colon_pos, colon_pos + 7, ":anchor")
+            || pw_substring_eq(text, colon_pos, colon_pos + 5, ":ref:")
+            || pw_substring_eq(text, colon_pos, colon_pos + 9, ":include:")) {
+            return true;
+        }
+        pos = colon_pos + 1;
+        if (pos >= text_len) {
+            break;
+        }
+    }
+    return false;
+}
+
+static PwResult split_blocks(PwValuePtr text)
+/*
+ * Split `text` into top-level blocks.
+ * Return array of blocks.
+ */
+{
+    PwValue blocks = PwArray();
+    pw_return_if_error(&blocks);
+
+    unsigned text_len = pw_strlen(text);
+    unsigned block_start = UINT_MAX;
+    unsigned pos = 0;
+    while (pos < text_len) {{
+        unsigned eol;
+        if (!pw_strchr(text, '\n', pos, &eol)) {
+            eol = text_len;
+        }
+        if (eol > pos) {
+            char32_t chr = pw_char_at(text, pos);
+            if (!pw_isspace(chr) && chr != MW_COMMENT) {
+                // line with zero indent starts new block
+                if (block_start != UINT_MAX) {
+                    PwValue block = pw_substr(text, block_start, pos);
+                    pw_return_if_error(&block);
+                    pw_expect_ok( pw_array_append(&blocks, &block) );
+                }
+                block_start = pos;
+            }
+        }
+        pos = eol + 1;
+    }}
+    if (block_start != UINT_MAX) {
+        PwValue block = pw_substr(text, block_start, text_len);
+        pw_return_if_error(&block);
+        pw_expect_ok( pw_array_append(&blocks, &block) );
+    }
+    return pw_move(&blocks);
+}
+
+static PwResult parse_block(PwValuePtr block)
+/*
+ * Parse top-level block which must be a map with one key.
+ * Return PwNull() if block is not a map entry or cannot be parsed alone.
+ */
+{
+    PwValue reader = pw_create_string_io(block);
+    pw_return_if_error(&reader);
+
+    PwValue result = mw_parse(&reader);
+    if (pw_error(&result)) {
+        if (result.type_id == PwTypeId_MwStatus) {
+            // parse error, let full parse report it with correct context
+            return PwNull();
+        }
+        return pw_move(&result);
+    }
+    if (!pw_is_map(&result) || pw_map_length(&result) != 1) {
+        return PwNull();
+    }
+    return pw_move(&result);
+}
+
+static PwResult reparse_blocks(PwValuePtr previous_tree, PwValuePtr old_text, PwValuePtr new_text)
+/*
+ * Return new tree or PwNull() if incremental reparse is not possible.
+ */
+{
+    if (!pw_is_map(previous_tree)) {
+        return PwNull();
+    }
+    if (has_dependencies(old_text) || has_dependencies(new_text)) {
+        return PwNull();
+    }
+
+    PwValue old_blocks = split_blocks(old_text);
+    pw_return_if_error(&old_blocks);
+
+    unsigned num_old_blocks = pw_array_length(&old_blocks);
+    if (num_old_blocks != pw_map_length(previous_tree)) {
+        // not a plain map, or it has duplicate keys
+        return PwNull();
+    }
+
+    PwValue new_blocks = split_blocks(new_text);
+    pw_return_if_error(&new_blocks);
+
+    unsigned num_new_blocks = pw_array_length(&new_blocks);
+    if (num_new_blocks == 0) {
+        return PwNull();
+    }
+
+    // map text of old blocks to their indexes in previous tree
+    PwValue old_index = PwMap();
+    pw_return_if_error(&old_index);
+    for (unsigned i = 0; i < num_old_blocks; i++) {{
+        PwValue block = pw_array_item(&old_blocks, i);
+        PwValue index = PwUnsigned(i);
+        pw_expect_ok( pw_map_update(&old_index, &block, &index) );
+    }}
+
+    PwValue result = PwMap();
+    pw_return_if_error(&result);
+
+    for (unsigned i = 0; i < num_new_blocks; i++) {{
+        PwValue block = pw_array_item(&new_blocks, i);
+        PwValue key = PwNull();
+        PwValue value = PwNull();
+
+        if (pw_map_has_key(&old_index, &block)) {
+            // unchanged block, reuse subtree
+            PwValue index = pw_map_get(&old_index, &block);
+            pw_map_item(previous_tree, index.unsigned_value, &key, &value);
+        } else {
+            PwValue entry = parse_block(&block);
+            pw_return_if_error(&entry);
+            if (pw_is_null(&entry)) {
+                return PwNull();
+            }
+            pw_map_item(&entry, 0, &key, &value);
+        }
+        pw_expect_ok( pw_map_update(&result, &key, &value) );
+    }}
+    return pw_move(&result);
+}
+
+PwResult mw_reparse(PwValuePtr previous_tree, PwValuePtr old_text, PwValuePtr new_text)
+{
+    PwValue result = reparse_blocks(previous_tree, old_text, new_text);
+    pw_return_if_error(&result);
+
+    if (!pw_is_null(&result)) {
+        return pw_move(&result);
+    }
+
+    // parse the whole text
+    PwValue reader = pw_create_string_io(new_text);
+    pw_return_if_error(&reader);
+
+    return mw_parse(&reader);
+}
@@ -0,0 +1,383 @@
+#include <string.h>
+
+#include <myaw.h>
+
+static int find_field(MwSchema* schema, PwValuePtr key)
+/*
+ * Return index of field that matches `key` or -1 if not found.
+ */
+{
+    if (schema->find_field) {
+        return schema->find_field(key);
+    }
+    if (!pw_is_string(key)) {
+        return -1;
+    }
+    unsigned key_len = pw_strlen(key);
+    for (unsigned i = 0; i < schema->num_fields; i++) {
+        char* name = schema->fields[i].name;
+        if (strlen(name) == key_len && pw_substring_eq(key, 0, key_len, name)) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+static bool store_scalar(MwFieldType type, void* ptr, PwValuePtr value)
+/*
+ * Convert scalar `value` to `type` and write it to `ptr`.
+ * Return false if value cannot be converted.
+ */
+{
+    switch (type) {
+        case MW_FIELD_BOOL:
+            if (pw_is_bool(value)) {
+                *((bool*) ptr) = value->bool_value;
+                return true;
+            }
+            break;
+
+        case MW_FIELD_SIGNED:
+            if (pw_is_signed(value)) {
+                *((int64_t*) ptr) = value->signed_value;
+                return true;
+            }
+            if (pw_is_unsigned(value) && value->unsigned_value <= INT64_MAX) {
+                *((int64_t*) ptr) = (int64_t) value->unsigned_value;
+                return true;
+            }
+            break;
+
+        case MW_FIELD_UNSIGNED:
+            if (pw_is_unsigned(value)) {
+                *((uint64_t*) ptr) = value->unsigned_value;
+                return true;
+            }
+            if (pw_is_signed(value) && value->signed_value >= 0) {
+                *((uint64_t*) ptr) = (uint64_t) value->signed_value;
+                return true;
+            }
+            break;
+
+        case MW_FIELD_FLOAT:
+            if (pw_is_float(value)) {
+                *((double*) ptr) = value->float_value;
+                return true;
+            }
+            if (pw_is_signed(value)) {
+                *((double*) ptr) = (double) value->signed_value;
+                return true;
+            }
+            if (pw_is_unsigned(value)) {
+                *((double*) ptr) = (double) value->unsigned_value;
+                return true;
+            }
+            break;
+
+        default:
+            break;
+    }
+    return false;
+}
+
+static PwResult store_value(MwParser* parser, MwSchemaField* field, void* ptr, PwValuePtr value,
+                            unsigned line_number, unsigned position)
+/*
+ * Convert `value` to the type of `field` and write it to `ptr`.
+ */
+{
+    if (field->type == MW_FIELD_VALUE) {
+        PwValuePtr dest = ptr;
+        pw_destroy(dest);
+        *dest = pw_move(value);
+        return PwOK();
+    }
+    // MW_FIELD_STRUCT gets here if the value was produced by conversion specifier, that's an error
+    if (store_scalar(field->type, ptr, value)) {
+        return PwOK();
+    }
+    return mw_parser_error2(parser, line_number, position, "Bad type of value for %s", field->name);
+}
+
+static PwResult parse_struct(MwParser* parser, MwSchema* schema, char* out);
+
+static PwResult parse_field(MwParser* parser, MwSchemaField* field, char* out,
+                            unsigned value_pos, PwValuePtr convspec)
+/*
+ * Parse value as a nested block starting from `value_pos`, similar to parse_map.
+ */
+{
+    unsigned saved_block_indent;
+    PwValue status = PwNull();
+    if (_mw_comment_or_end_of_line(parser, value_pos)) {
+        status = _mw_start_nested_block_from_next_line(parser, &saved_block_indent);
+    } else {
+        status = _mw_start_nested_block(parser, value_pos, &saved_block_indent);
+    }
+    pw_return_if_error(&status);
+
+    unsigned line_number = parser->line_number;
+    unsigned position = _mw_get_start_position(parser);
+
+    void* ptr = out + field->offset;
+    PwValue result = PwNull();
+    if (field->type == MW_FIELD_STRUCT && !pw_is_string(convspec)) {
+        result = parse_struct(parser, field->schema, ptr);
+    } else {
+        PwValue value = PwNull();
+        if (pw_is_string(convspec)) {
+            MwBlockParserFunc parser_func = _mw_get_custom_parser(parser, convspec);
+            value = parser_func(parser);
+        } else {
+            value = _mw_parse_value(parser, nullptr, nullptr);
+        }
+        if (pw_error(&value)) {
+            result = pw_move(&value);
+        } else {
+            result = store_value(parser, field, ptr, &value, line_number, position);
+        }
+    }
+    _mw_end_nested_block(parser, saved_block_indent);
+    return pw_move(&result);
+}
+
+static PwResult parse_struct(MwParser* parser, MwSchema* schema, char* out)
+/*
+ * Parse map starting from the current block position.
+ */
+{
+    if (schema->num_fields > MW_MAX_SCHEMA_FIELDS) {
+        return mw_parser_error(parser, parser->current_indent, "Too many fields in schema");
+    }
+
+    uint64_t seen = 0;
+    unsigned start_line = parser->line_number;
+
+    /*
+     * All keys in the map must have the same indent.
+     * Save indent of the first key (current one) and check it for subsequent keys.
+     */
+    unsigned key_indent = _mw_get_start_position(parser);
+
+    for (;;) {
+        {
+            PwValue status = _mw_count_node(parser);
+            pw_return_if_error(&status);
+
+            unsigned value_pos;
+            PwValue convspec = PwNull();
+            PwValue key = _mw_parse_value(parser, &value_pos, &convspec);
+            pw_return_if_error(&key);
+
+            int i = find_field(schema, &key);
+            if (i < 0) {
+                if (!schema->skip_unknown_keys) {
+                    return mw_parser_error(parser, key_indent, "Unknown key");
+                }
+                PwValue status = _mw_skip_value(parser, key_indent);
+                pw_return_if_error(&status);
+            } else {
+                uint64_t mask = 1ULL << i;
+                if (seen & mask) {
+                    return mw_parser_error(parser, key_indent, "Duplicate key %s", schema->fields[i].name);
+                }
+                seen |= mask;
+
+                PwValue status = parse_field(parser, &schema->fields[i], out, value_pos, &convspec);
+                pw_return_if_error(&status);
+            }
+        }
+        {
+            PwValue status = _mw_read_block_line(parser);
+            if (_mw_end_of_block(&status)) {
+                break;
+            }
+            pw_return_if_error(&status);
+
+            if (parser->current_indent != key_indent) {
+                return mw_parser_error(parser, parser->current_indent, "Bad indentation of map key");
+            }
+        }
+    }
+
+    // check required fields
+    for (unsigned i = 0; i < schema->num_fields; i++) {
+        if (schema->fields[i].required && !(seen & (1ULL << i))) {
+            return mw_parser_error2(parser, start_line, key_indent, "Missing key %s", schema->fields[i].name);
+        }
+    }
+    return PwOK();
+}
+
+PwResult mw_parse_into(PwValuePtr markup, MwSchema* schema, void* out)
+{
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
+    if (!parser) {
+        return PwOOM();
+    }
+    return mw_parser_parse_into(parser, schema, out);
+}
+
+static PwResult parse_document(MwParser* parser, MwSchema* schema, MwBindFunc bind_func, void* out)
+/*
+ * Parse top-level map either with `bind_func` or according to `schema`.
+ */
+{
+    // read first line to prepare for parsing and to detect EOF
+    PwValue status = _mw_read_block_line(parser);
+    if (_mw_end_of_block(&status) && parser->eof) {
+        return PwStatus(PW_ERROR_EOF);
+    }
+    pw_return_if_error(&status);
+
+    // parse top-level map
+    PwValue result = PwNull();
+    if (bind_func) {
+        result = bind_func(parser, out);
+    } else {
+        result = parse_struct(parser, schema, out);
+    }
+    pw_return_if_error(&result);
+
+    // make sure markup has no more data
+    status = _mw_read_block_line(parser);
+    if (parser->eof) {
+        // all right, no op
+    } else {
+        pw_return_if_error(&status);
+        return mw_parser_error(parser, parser->current_indent, "Extra data after parsed value");
+    }
+    return PwOK();
+}
+
+PwResult mw_parser_parse_into(MwParser* parser, MwSchema* schema, void* out)
+{
+    return parse_document(parser, schema, nullptr, out);
+}
+
+/****************************************************************
+ * Support for parsers generated by myaw_codegen
+ */
+
+static char32_t number_terminators[] = { MW_COMMENT, 0 };
+
+static PwResult start_value_block(MwParser* parser, unsigned value_pos, unsigned* saved_block_indent)
+/*
+ * Start nested block for the value of map key, same as parse_field does.
+ */
+{
+    if (_mw_comment_or_end_of_line(parser, value_pos)) {
+        return _mw_start_nested_block_from_next_line(parser, saved_block_indent);
+    } else {
+        return _mw_start_nested_block(parser, value_pos, saved_block_indent);
+    }
+}
+
+static PwResult parse_scalar(MwParser* parser, unsigned start_pos, unsigned* end_pos)
+/*
+ * Parse boolean or number in the current line.
+ * Return null if the value is neither of them.
+ */
+{
+    PwValuePtr current_line = &parser->current_line;
+
+    if (pw_substring_eq(current_line, start_pos, start_pos + 4, "true")) {
+        *end_pos = start_pos + 4;
+        return PwBool(true);
+    }
+    if (pw_substring_eq(current_line, start_pos, start_pos + 5, "false")) {
+        *end_pos = start_pos + 5;
+        return PwBool(false);
+    }
+    int sign = 1;
+    char32_t chr = pw_char_at(current_line, start_pos);
+    if (chr == '+' || chr == '-') {
+        if (chr == '-') {
+            sign = -1;
+        }
+        start_pos++;
+        if (!pw_string_index_valid(current_line, start_pos)) {
+            return PwNull();
+        }
+        chr = pw_char_at(current_line, start_pos);
+    }
+    if (chr < '0' || chr > '9') {
+        return PwNull();
+    }
+    return _mw_parse_number(parser, start_pos, sign, end_pos, number_terminators);
+}
+
+PwResult _mw_bind_scalar(MwParser* parser, unsigned value_pos, PwValuePtr convspec,
+                         MwFieldType type, char* name, void* out)
+{
+    if (pw_is_string(convspec)) {
+        return mw_parser_error(parser, value_pos, "Conversion specifier is not allowed for %s", name);
+    }
+    unsigned saved_block_indent;
+    PwValue status = start_value_block(parser, value_pos, &saved_block_indent);
+    pw_return_if_error(&status);
+
+    unsigned start_pos = _mw_get_start_position(parser);
+    unsigned end_pos;
+    PwValue value = parse_scalar(parser, start_pos, &end_pos);
+    if (pw_error(&value)) {
+        status = pw_move(&value);
+    } else if (!store_scalar(type, out, &value)) {
+        status = mw_parser_error(parser, start_pos, "Bad type of value for %s", name);
+    } else if (!_mw_comment_or_end_of_line(parser, end_pos)) {
+        status = mw_parser_error(parser, end_pos, "Bad character encountered");
+    } else {
+        // make sure the block has no more data
+        PwValue next_line = _mw_read_block_line(parser);
+        if (!_mw_end_of_block(&next_line)) {
+            if (pw_error(&next_line)) {
+                status = pw_move(&next_line);
+            } else {
+                status = mw_parser_error(parser, parser->current_indent, "Single-line value expected for %s", name);
+            }
+        }
+    }
+    _mw_end_nested_block(parser, saved_block_indent);
+    return pw_move(&status);
+}
+
+PwResult _mw_bind_value(MwParser* parser, unsigned value_pos, PwValuePtr convspec, PwValuePtr out)
+{
+    unsigned saved_block_indent;
+    PwValue status = start_value_block(parser, value_pos, &saved_block_indent);
+    pw_return_if_error(&status);
+
+    PwValue value = PwNull();
+    if (pw_is_string(convspec)) {
+        MwBlockParserFunc parser_func = _mw_get_custom_parser(parser, convspec);
+        value = parser_func(parser);
+    } else {
+        value = _mw_parse_value(parser, nullptr, nullptr);
+    }
+    _mw_end_nested_block(parser, saved_block_indent);
+    pw_return_if_error(&value);
+
+    pw_destroy(out);
+    *out = pw_move(&value);
+    return PwOK();
+}
+
+PwResult _mw_bind_struct(MwParser* parser, unsigned value_pos, PwValuePtr convspec,
+                         char* name, MwBindFunc bind_func, void* out)
+{
+    if (pw_is_string(convspec)) {
+        return mw_parser_error(parser, value_pos, "Bad type of value for %s", name);
+    }
+    unsigned saved_block_indent;
+    PwValue status = start_value_block(parser, value_pos, &saved_block_indent);
+    pw_return_if_error(&status);
+
+    status = bind_func(parser, out);
+    _mw_end_nested_block(parser, saved_block_indent);
+    return pw_move(&status);
+}
+
+PwResult _mw_bind_document(MwParser* parser, MwBindFunc bind_func, void* out)
+{
+    return parse_document(parser, nullptr, bind_func, out);
+}
@@ -0,0 +1,258 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <myaw.h>
+
+// number of characters escaped per reservation in the buffer
+#define ESCAPE_CHUNK  4096
+
+// escape sequences for ASCII characters, 'u' stands for \u00XX
+static char escape_table[128] = {
+    ['\0'] = 'u', [0x01] = 'u', [0x02] = 'u', [0x03] = 'u',
+    [0x04] = 'u', [0x05] = 'u', [0x06] = 'u', [0x07] = 'u',
+    ['\b'] = 'b', ['\t'] = 't', ['\n'] = 'n', [0x0B] = 'u',
+    ['\f'] = 'f', ['\r'] = 'r', [0x0E] = 'u', [0x0F] = 'u',
+    [0x10] = 'u', [0x11] = 'u', [0x12] = 'u', [0x13] = 'u',
+    [0x14] = 'u', [0x15] = 'u', [0x16] = 'u', [0x17] = 'u',
+    [0x18] = 'u', [0x19] = 'u', [0x1A] = 'u', [0x1B] = 'u',
+    [0x1C] = 'u', [0x1D] = 'u', [0x1E] = 'u', [0x1F] = 'u',
+    ['"']  = '"', ['\\'] = '\\', [0x7F] = 'u'
+};
+
+static PwResult write_iov(int fd, struct iovec* iov, int iovcnt)
+/*
+ * Write all data, retrying after partial writes.
+ */
+{
+    while (iovcnt) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return PwErrno(errno);
+        }
+        while (iovcnt && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt) {
+            iov->iov_base = (char*) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return PwOK();
+}
+
+static bool grow(MwSink* sink, size_t size)
+{
+    size_t capacity = sink->capacity? sink->capacity : MW_SINK_BUFFER_SIZE;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    char* data = realloc(sink->data, capacity);
+    if (!data) {
+        return false;
+    }
+    sink->data = data;
+    sink->capacity = capacity;
+    return true;
+}
+
+PwResult mw_sink_init(MwSink* sink, int fd, size_t buffer_size)
+{
+    sink->fd = fd;
+    sink->data = nullptr;
+    sink->length = 0;
+    sink->capacity = 0;
+    if (!grow(sink, buffer_size? buffer_size : MW_SINK_BUFFER_SIZE)) {
+        return PwOOM();
+    }
+    return PwOK();
+}
+
+void mw_sink_fini(MwSink* sink)
+{
+    free(sink->data);
+    sink->data = nullptr;
+    sink->length = 0;
+    sink->capacity = 0;
+}
+
+PwResult mw_sink_flush(MwSink* sink)
+{
+    if (sink->fd == -1 || sink->length == 0) {
+        return PwOK();
+    }
+    struct iovec iov = { .iov_base = sink->data, .iov_len = sink->length };
+    sink->length = 0;
+    return write_iov(sink->fd, &iov, 1);
+}
+
+PwResult mw_sink_write(MwSink* sink, char* data, size_t size)
+{
+    if (sink->length + size <= sink->capacity) {
+        memcpy(sink->data + sink->length, data, size);
+        sink->length += size;
+        return PwOK();
+    }
+    if (sink->fd == -1) {
+        if (!grow(sink, sink->length + size)) {
+            return PwOOM();
+        }
+        memcpy(sink->data + sink->length, data, size);
+        sink->length += size;
+        return PwOK();
+    }
+    if (size < sink->capacity) {
+        PwValue status = mw_sink_flush(sink);
+        pw_return_if_error(&status);
+
+        memcpy(sink->data, data, size);
+        sink->length = size;
+        return PwOK();
+    }
+    // large chunk of data, write it along with buffered data without copying
+    struct iovec iov[2] = {
+        { .iov_base = sink->data, .iov_len = sink->length },
+        { .iov_base = data,       .iov_len = size }
+    };
+    sink->length = 0;
+    return write_iov(sink->fd, iov, 2);
+}
+
+PwResult _mw_sink_reserve(MwSink* sink, size_t size, char** ptr)
+{
+    if (sink->length + size > sink->capacity) {
+        if (sink->fd != -1 && size <= sink->capacity) {
+            PwValue status = mw_sink_flush(sink);
+            pw_return_if_error(&status);
+        } else if (!grow(sink, sink->length + size)) {
+            return PwOOM();
+        }
+    }
+    *ptr = sink->data + sink->length;
+    return PwOK();
+}
+
+PwResult _mw_sink_write_char(MwSink* sink, char32_t chr)
+{
+    char* p;
+    PwValue status = _mw_sink_reserve(sink, 4, &p);
+    pw_return_if_error(&status);
+
+    char* start = p;
+    if (chr < 0x80) {
+        *p++ = (char) chr;
+    } else if (chr < 0x800) {
+        *p++ = (char) (0xC0 | (chr >> 6));
+        *p++ = (char) (0x80 | (chr & 0x3F));
+    } else if (chr < 0x10000) {
+        *p++ = (char) (0xE0 | (chr >> 12));
+        *p++ = (char) (0x80 | ((chr >> 6) & 0x3F));
+        *p++ = (char) (0x80 | (chr & 0x3F));
+    } else {
+        *p++ = (char) (0xF0 | (chr >> 18));
+        *p++ = (char) (0x80 | ((chr >> 12) & 0x3F));
+        *p++ = (char) (0x80 | ((chr >> 6) & 0x3F));
+        *p++ = (char) (0x80 | (chr & 0x3F));
+    }
+    sink->length += p - start;
+    return PwOK();
+}
+
+PwResult _mw_sink_write_quoted(MwSink* sink, PwValuePtr str)
+/*
+ * Space for the worst case is reserved for a chunk of characters at once,
+ * so the inner loop writes to the buffer without checks.
+ */
+{
+    static char hex[] = "0123456789abcdef";
+
+    PwValue status = mw_sink_write(sink, "\"", 1);
+    pw_return_if_error(&status);
+
+    unsigned length = pw_strlen(str);
+    for (unsigned pos = 0; pos < length;) {
+        unsigned end_pos = pos + ESCAPE_CHUNK;
+        if (end_pos > length) {
+            end_pos = length;
+        }
+        char* p;
+        // \u00XX is the longest form
+        status = _mw_sink_reserve(sink, (end_pos - pos) * 6, &p);
+        pw_return_if_error(&status);
+
+        char* start = p;
+        for (; pos < end_pos; pos++) {
+            char32_t chr = pw_char_at(str, pos);
+            if (chr >= 0x80) {
+                if (chr < 0x800) {
+                    *p++ = (char) (0xC0 | (chr >> 6));
+                    *p++ = (char) (0x80 | (chr & 0x3F));
+                } else if (chr < 0x10000) {
+                    *p++ = (char) (0xE0 | (chr >> 12));
+                    *p++ = (char) (0x80 | ((chr >> 6) & 0x3F));
+                    *p++ = (char) (0x80 | (chr & 0x3F));
+                } else {
+                    *p++ = (char) (0xF0 | (chr >> 18));
+                    *p++ = (char) (0x80 | ((chr >> 12) & 0x3F));
+                    *p++ = (char) (0x80 | ((chr >> 6) & 0x3F));
+                    *p++ = (char) (0x80 | (chr & 0x3F));
+                }
+                continue;
+            }
+            char escape = escape_table[chr];
+            if (!escape) {
+                *p++ = (char) chr;
+            } else if (escape == 'u') {
+                *p++ = '\\';
+                *p++ = 'u';
+                *p++ = '0';
+                *p++ = '0';
+                *p++ = hex[chr >> 4];
+                *p++ = hex[chr & 15];
+            } else {
+                *p++ = '\\';
+                *p++ = escape;
+            }
+        }
+        sink->length += p - start;
+    }
+    return mw_sink_write(sink, "\"", 1);
+}
+
+PwResult _mw_sink_write_number(MwSink* sink, PwValuePtr value)
+{
+    // numbers are formatted directly into the buffer
+    char* p;
+    PwValue status = _mw_sink_reserve(sink, 32, &p);
+    pw_return_if_error(&status);
+
+    int n;
+    if (pw_is_signed(value)) {
+        n = snprintf(p, 32, "%lld", (long long) value->signed_value);
+    } else if (pw_is_unsigned(value)) {
+        n = snprintf(p, 32, "%llu", (unsigned long long) value->unsigned_value);
+    } else if (pw_is_float(value)) {
+        if (!isfinite(value->float_value)) {
+            return PwError(MW_UNSUPPORTED_TYPE);
+        }
+        n = snprintf(p, 32, "%.17g", value->float_value);
+        if (!memchr(p, '.', n) && !memchr(p, 'e', n)) {
+            // make sure it is parsed back as float
+            p[n++] = '.';
+            p[n++] = '0';
+        }
+    } else {
+        return PwError(MW_UNSUPPORTED_TYPE);
+    }
+    sink->length += n;
+    return PwOK();
+}
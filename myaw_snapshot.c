@@ -0,0 +1,772 @@
+// for qsort_r
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <myaw.h>
+
+/*
+ * Snapshot layout.
+ *
+ * All integers are in host byte order, snapshots are not portable
+ * across architectures. All offsets are relative to the beginning of file.
+ *
+ * Header is followed by nodes, each aligned on 8 bytes:
+ *
+ *   null, bool:        uint32 type, uint32 value
+ *   signed, unsigned,
+ *   float:             uint32 type, uint32 padding, 64-bit value
+ *   string:            uint32 type, uint32 length in bytes, UTF-8 data, terminating zero
+ *   array:             uint32 type, uint32 length, uint32 item offsets
+ *   int64[], float64[]: uint32 type, uint32 length, 64-bit items
+ *   map:               uint32 type, uint32 length, pairs of uint32 key and value offsets,
+ *                      uint32 pair indices sorted by key
+ *
+ * Pairs are kept in the original order, sorted indices are for lookups:
+ * string keys go first in byte order, keys of other types follow them.
+ *
+ * Equal strings are stored once and shared by all referring nodes.
+ */
+
+#define SNAPSHOT_MAGIC       "MYAWSNAP"
+#define SNAPSHOT_VERSION     2
+#define SNAPSHOT_BYTE_ORDER  0x01020304
+#define SNAPSHOT_MAX_SIZE    UINT32_MAX
+
+// nesting limit for conversion to values, JSON may be nested in blocks
+#define SNAPSHOT_MAX_DEPTH   (2 * MW_MAX_RECURSION_DEPTH)
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t size;
+    uint32_t root;
+    uint32_t reserved;
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t value;  // bool value, string length, number of items, or padding
+} NodeHeader;
+
+struct _MwSnapshot {
+    char*  data;
+    size_t size;
+};
+
+/****************************************************************
+ * Writer
+ */
+
+typedef struct {
+    char*    data;
+    size_t   size;
+    size_t   capacity;
+    _PwValue strings;      // map of strings to offsets
+    uint32_t sort_offset;  // map node being sorted by compare_pairs
+} Writer;
+
+static bool reserve(Writer* writer, size_t size, uint32_t* offset)
+/*
+ * Reserve `size` bytes aligned on 8 bytes and write their offset.
+ */
+{
+    size_t start = (writer->size + 7) & ~(size_t) 7;
+    size_t end = start + size;
+    if (end > SNAPSHOT_MAX_SIZE) {
+        return false;
+    }
+    if (end > writer->capacity) {
+        size_t capacity = writer->capacity? writer->capacity : 65536;
+        while (capacity < end) {
+            capacity *= 2;
+        }
+        char* data = realloc(writer->data, capacity);
+        if (!data) {
+            return false;
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    memset(writer->data + writer->size, 0, end - writer->size);
+    writer->size = end;
+    *offset = (uint32_t) start;
+    return true;
+}
+
+static inline NodeHeader* node_at(Writer* writer, uint32_t offset)
+{
+    return (NodeHeader*) (writer->data + offset);
+}
+
+static unsigned utf8_length(char32_t chr)
+{
+    if (chr < 0x80) {
+        return 1;
+    } else if (chr < 0x800) {
+        return 2;
+    } else if (chr < 0x10000) {
+        return 3;
+    } else {
+        return 4;
+    }
+}
+
+static char* encode_utf8(char32_t chr, char* p)
+{
+    if (chr < 0x80) {
+        *p++ = (char) chr;
+    } else if (chr < 0x800) {
+        *p++ = (char) (0xC0 | (chr >> 6));
+        *p++ = (char) (0x80 | (chr & 0x3F));
+    } else if (chr < 0x10000) {
+        *p++ = (char) (0xE0 | (chr >> 12));
+        *p++ = (char) (0x80 | ((chr >> 6) & 0x3F));
+        *p++ = (char) (0x80 | (chr & 0x3F));
+    } else {
+        *p++ = (char) (0xF0 | (chr >> 18));
+        *p++ = (char) (0x80 | ((chr >> 12) & 0x3F));
+        *p++ = (char) (0x80 | ((chr >> 6) & 0x3F));
+        *p++ = (char) (0x80 | (chr & 0x3F));
+    }
+    return p;
+}
+
+static PwResult write_string(Writer* writer, PwValuePtr str, uint32_t* offset)
+{
+    if (pw_map_has_key(&writer->strings, str)) {
+        PwValue existing = pw_map_get(&writer->strings, str);
+        *offset = (uint32_t) existing.unsigned_value;
+        return PwOK();
+    }
+
+    unsigned length = pw_strlen(str);
+    size_t utf8_len = 0;
+    for (unsigned i = 0; i < length; i++) {
+        utf8_len += utf8_length(pw_char_at(str, i));
+    }
+    if (!reserve(writer, sizeof(NodeHeader) + utf8_len + 1, offset)) {
+        return PwOOM();
+    }
+    NodeHeader* node = node_at(writer, *offset);
+    node->type = MW_NODE_STRING;
+    node->value = (uint32_t) utf8_len;
+
+    char* p = (char*) (node + 1);
+    for (unsigned i = 0; i < length; i++) {
+        p = encode_utf8(pw_char_at(str, i), p);
+    }
+    *p = 0;
+
+    PwValue key = pw_clone(str);
+    PwValue value = PwUnsigned(*offset);
+    return pw_map_update(&writer->strings, &key, &value);
+}
+
+static PwResult write_scalar(Writer* writer, MwNodeType type, uint64_t value, uint32_t* offset)
+{
+    if (!reserve(writer, sizeof(NodeHeader) + sizeof(uint64_t), offset)) {
+        return PwOOM();
+    }
+    NodeHeader* node = node_at(writer, *offset);
+    node->type = type;
+    memcpy(node + 1, &value, sizeof(value));
+    return PwOK();
+}
+
+static int compare_keys(char* data, uint32_t a, uint32_t b)
+/*
+ * Compare key nodes at offsets `a` and `b`.
+ * Strings are ordered by bytes, shorter string goes first if it is a prefix of another.
+ * Strings precede keys of other types, return zero for two non-string keys.
+ */
+{
+    NodeHeader* key_a = (NodeHeader*) (data + a);
+    NodeHeader* key_b = (NodeHeader*) (data + b);
+    bool a_is_string = key_a->type == MW_NODE_STRING;
+    bool b_is_string = key_b->type == MW_NODE_STRING;
+    if (!a_is_string || !b_is_string) {
+        return (int) b_is_string - (int) a_is_string;
+    }
+    uint32_t len_a = key_a->value;
+    uint32_t len_b = key_b->value;
+    int result = memcmp(key_a + 1, key_b + 1, (len_a < len_b)? len_a : len_b);
+    if (result) {
+        return result;
+    }
+    return (len_a > len_b) - (len_a < len_b);
+}
+
+static int compare_pairs(const void* a, const void* b, void* arg)
+/*
+ * qsort_r callback for sorting pair indices of a map node.
+ * `arg` points to the writer, the map node is at `writer->sort_offset`.
+ */
+{
+    Writer* writer = arg;
+    uint32_t* items = (uint32_t*) (node_at(writer, writer->sort_offset) + 1);
+    uint32_t index_a = *(uint32_t*) a;
+    uint32_t index_b = *(uint32_t*) b;
+    int result = compare_keys(writer->data, items[index_a * 2], items[index_b * 2]);
+    if (result) {
+        return result;
+    }
+    // keep non-string keys in original order
+    return (index_a > index_b) - (index_a < index_b);
+}
+
+static PwResult write_node(Writer* writer, PwValuePtr value, uint32_t* offset)
+{
+    if (pw_is_null(value) || pw_is_bool(value)) {
+        if (!reserve(writer, sizeof(NodeHeader), offset)) {
+            return PwOOM();
+        }
+        NodeHeader* node = node_at(writer, *offset);
+        if (pw_is_null(value)) {
+            node->type = MW_NODE_NULL;
+        } else {
+            node->type = MW_NODE_BOOL;
+            node->value = value->bool_value;
+        }
+        return PwOK();
+    }
+    if (pw_is_signed(value)) {
+        return write_scalar(writer, MW_NODE_SIGNED, (uint64_t) value->signed_value, offset);
+    }
+    if (pw_is_unsigned(value)) {
+        return write_scalar(writer, MW_NODE_UNSIGNED, value->unsigned_value, offset);
+    }
+    if (pw_is_float(value)) {
+        uint64_t bits;
+        double f = value->float_value;
+        memcpy(&bits, &f, sizeof(bits));
+        return write_scalar(writer, MW_NODE_FLOAT, bits, offset);
+    }
+    if (pw_is_string(value)) {
+        return write_string(writer, value, offset);
+    }
+    if (mw_is_packed_array(value)) {
+        MwPackedArrayData* data = _mw_packed_array_data_ptr(value);
+        if (!reserve(writer, sizeof(NodeHeader) + (size_t) data->length * sizeof(uint64_t), offset)) {
+            return PwOOM();
+        }
+        NodeHeader* node = node_at(writer, *offset);
+        node->type = (data->item_type == MW_PACKED_INT64)? MW_NODE_INT64_ARRAY : MW_NODE_FLOAT64_ARRAY;
+        node->value = data->length;
+        if (data->length) {
+            // both item types are 64 bit wide
+            memcpy(node + 1, data->items, (size_t) data->length * sizeof(uint64_t));
+        }
+        return PwOK();
+    }
+    if (pw_is_array(value)) {
+        unsigned length = pw_array_length(value);
+        if (!reserve(writer, sizeof(NodeHeader) + length * sizeof(uint32_t), offset)) {
+            return PwOOM();
+        }
+        NodeHeader* node = node_at(writer, *offset);
+        node->type = MW_NODE_ARRAY;
+        node->value = length;
+
+        for (unsigned i = 0; i < length; i++) {{
+            PwValue item = pw_array_item(value, i);
+            uint32_t item_offset;
+            PwValue status = write_node(writer, &item, &item_offset);
+            pw_return_if_error(&status);
+
+            // writer data could be reallocated, get node pointer again
+            uint32_t* items = (uint32_t*) (node_at(writer, *offset) + 1);
+            items[i] = item_offset;
+        }}
+        return PwOK();
+    }
+    if (pw_is_map(value)) {
+        unsigned length = pw_map_length(value);
+        if (!reserve(writer, sizeof(NodeHeader) + length * 3 * sizeof(uint32_t), offset)) {
+            return PwOOM();
+        }
+        NodeHeader* node = node_at(writer, *offset);
+        node->type = MW_NODE_MAP;
+        node->value = length;
+
+        for (unsigned i = 0; i < length; i++) {{
+            PwValue key = PwNull();
+            PwValue item = PwNull();
+            pw_map_item(value, i, &key, &item);
+
+            uint32_t key_offset;
+            PwValue status = write_node(writer, &key, &key_offset);
+            pw_return_if_error(&status);
+
+            uint32_t item_offset;
+            status = write_node(writer, &item, &item_offset);
+            pw_return_if_error(&status);
+
+            uint32_t* items = (uint32_t*) (node_at(writer, *offset) + 1);
+            items[i * 2] = key_offset;
+            items[i * 2 + 1] = item_offset;
+        }}
+        uint32_t* index = (uint32_t*) (node_at(writer, *offset) + 1) + length * 2;
+        for (unsigned i = 0; i < length; i++) {
+            index[i] = i;
+        }
+        writer->sort_offset = *offset;
+        qsort_r(index, length, sizeof(uint32_t), compare_pairs, writer);
+        return PwOK();
+    }
+    // date/time, timestamp, and custom values have no stable binary representation
+    return PwError(MW_UNSUPPORTED_TYPE);
+}
+
+static PwResult write_file(char* data, size_t size, char* path)
+/*
+ * Write data to temporary file and rename it to `path`
+ * so readers never see partially written snapshot.
+ */
+{
+    // the counter makes names unique among threads of the process
+    static _Atomic unsigned tmp_counter = 0;
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.%u.tmp", path, (int) getpid(),
+             atomic_fetch_add(&tmp_counter, 1));
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return PwErrno(errno);
+    }
+    while (size) {
+        ssize_t n = write(fd, data, size);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int err = errno;
+            close(fd);
+            unlink(tmp_path);
+            return PwErrno(err);
+        }
+        data += n;
+        size -= n;
+    }
+    // make sure data reaches the disk before rename,
+    // otherwise after a crash `path` may refer to empty file
+    if (fsync(fd) == -1) {
+        int err = errno;
+        close(fd);
+        unlink(tmp_path);
+        return PwErrno(err);
+    }
+    if (close(fd) == -1 || rename(tmp_path, path) == -1) {
+        int err = errno;
+        unlink(tmp_path);
+        return PwErrno(err);
+    }
+    return PwOK();
+}
+
+static void fini_writer(Writer* writer)
+{
+    free(writer->data);
+    writer->data = nullptr;
+    pw_destroy(&writer->strings);
+}
+
+PwResult mw_compile_value(PwValuePtr value, char* out_path)
+{
+    [[ gnu::cleanup(fini_writer) ]] Writer writer = {
+        .strings = PwMap()
+    };
+    pw_return_if_error(&writer.strings);
+
+    uint32_t header_offset;
+    if (!reserve(&writer, sizeof(SnapshotHeader), &header_offset)) {
+        return PwOOM();
+    }
+    uint32_t root;
+    PwValue status = write_node(&writer, value, &root);
+    pw_return_if_error(&status);
+
+    SnapshotHeader* header = (SnapshotHeader*) writer.data;
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = SNAPSHOT_VERSION;
+    header->byte_order = SNAPSHOT_BYTE_ORDER;
+    header->size = writer.size;
+    header->root = root;
+
+    return write_file(writer.data, writer.size, out_path);
+}
+
+PwResult mw_compile(PwValuePtr markup, char* out_path)
+{
+    PwValue value = mw_parse(markup);
+    pw_return_if_error(&value);
+
+    return mw_compile_value(&value, out_path);
+}
+
+/****************************************************************
+ * Reader
+ */
+
+PwResult mw_load_snapshot(char* path, MwSnapshot** result)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return PwErrno(errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        int err = errno;
+        close(fd);
+        return PwErrno(err);
+    }
+    if ((size_t) st.st_size < sizeof(SnapshotHeader) || (uint64_t) st.st_size > SNAPSHOT_MAX_SIZE) {
+        close(fd);
+        return PwError(MW_BAD_SNAPSHOT);
+    }
+    char* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+        return PwErrno(err);
+    }
+
+    SnapshotHeader* header = (SnapshotHeader*) data;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0
+        || header->version != SNAPSHOT_VERSION
+        || header->byte_order != SNAPSHOT_BYTE_ORDER
+        || header->size != (uint64_t) st.st_size
+        || header->root < sizeof(SnapshotHeader)
+        || (header->root & 7)
+        || header->root + sizeof(NodeHeader) > header->size) {
+
+        munmap(data, st.st_size);
+        return PwError(MW_BAD_SNAPSHOT);
+    }
+
+    MwSnapshot* snapshot = allocate(sizeof(MwSnapshot), true);
+    if (!snapshot) {
+        munmap(data, st.st_size);
+        return PwOOM();
+    }
+    snapshot->data = data;
+    snapshot->size = st.st_size;
+    *result = snapshot;
+    return PwOK();
+}
+
+void mw_unload_snapshot(MwSnapshot** snapshot_ptr)
+{
+    MwSnapshot* snapshot = *snapshot_ptr;
+    *snapshot_ptr = nullptr;
+    if (snapshot) {
+        munmap(snapshot->data, snapshot->size);
+        release((void**) &snapshot, sizeof(MwSnapshot));
+    }
+}
+
+MwNode mw_snapshot_root(MwSnapshot* snapshot)
+{
+    SnapshotHeader* header = (SnapshotHeader*) snapshot->data;
+    return (MwNode) { .snapshot = snapshot, .offset = header->root };
+}
+
+static NodeHeader* get_node(MwNode node)
+/*
+ * Return pointer to node header or nullptr if offset is out of range
+ * or is not aligned.
+ */
+{
+    if (node.offset < sizeof(SnapshotHeader) || (node.offset & 7)
+        || node.offset + sizeof(NodeHeader) > node.snapshot->size) {
+        return nullptr;
+    }
+    return (NodeHeader*) (node.snapshot->data + node.offset);
+}
+
+static uint64_t get_scalar(MwNode node, MwNodeType type)
+/*
+ * Return 64-bit value of scalar node or zero if node has different type.
+ */
+{
+    NodeHeader* header = get_node(node);
+    uint64_t value = 0;
+    if (header && header->type == type
+        && node.offset + sizeof(NodeHeader) + sizeof(uint64_t) <= node.snapshot->size) {
+        memcpy(&value, header + 1, sizeof(value));
+    }
+    return value;
+}
+
+static uint32_t* get_items(MwNode node, unsigned num_offsets)
+/*
+ * Return pointer to item offsets of array or map, or nullptr if out of range.
+ */
+{
+    NodeHeader* header = get_node(node);
+    if (!header) {
+        return nullptr;
+    }
+    if (node.offset + sizeof(NodeHeader) + (size_t) num_offsets * sizeof(uint32_t) > node.snapshot->size) {
+        return nullptr;
+    }
+    return (uint32_t*) (header + 1);
+}
+
+MwNodeType mw_node_type(MwNode node)
+{
+    NodeHeader* header = get_node(node);
+    return header? (MwNodeType) header->type : MW_NODE_NULL;
+}
+
+bool mw_node_bool(MwNode node)
+{
+    NodeHeader* header = get_node(node);
+    return header && header->type == MW_NODE_BOOL && header->value;
+}
+
+int64_t mw_node_signed(MwNode node)
+{
+    return (int64_t) get_scalar(node, MW_NODE_SIGNED);
+}
+
+uint64_t mw_node_unsigned(MwNode node)
+{
+    return get_scalar(node, MW_NODE_UNSIGNED);
+}
+
+double mw_node_float(MwNode node)
+{
+    uint64_t bits = get_scalar(node, MW_NODE_FLOAT);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+char* mw_node_string(MwNode node, unsigned* length)
+{
+    NodeHeader* header = get_node(node);
+    if (!header || header->type != MW_NODE_STRING
+        || node.offset + sizeof(NodeHeader) + (size_t) header->value + 1 > node.snapshot->size) {
+        if (length) {
+            *length = 0;
+        }
+        return nullptr;
+    }
+    if (length) {
+        *length = header->value;
+    }
+    return (char*) (header + 1);
+}
+
+unsigned mw_node_length(MwNode node)
+{
+    NodeHeader* header = get_node(node);
+    if (header && (header->type == MW_NODE_ARRAY || header->type == MW_NODE_MAP
+                   || header->type == MW_NODE_INT64_ARRAY || header->type == MW_NODE_FLOAT64_ARRAY)) {
+        return header->value;
+    }
+    return 0;
+}
+
+static void* get_packed_items(MwNode node, MwNodeType type)
+/*
+ * Return pointer to items of packed array node, or nullptr if type does not match
+ * or items are out of range.
+ */
+{
+    NodeHeader* header = get_node(node);
+    if (!header || header->type != type
+        || node.offset + sizeof(NodeHeader) + (size_t) header->value * sizeof(uint64_t) > node.snapshot->size) {
+        return nullptr;
+    }
+    return header + 1;
+}
+
+int64_t* mw_node_int64_items(MwNode node)
+{
+    return get_packed_items(node, MW_NODE_INT64_ARRAY);
+}
+
+double* mw_node_float64_items(MwNode node)
+{
+    return get_packed_items(node, MW_NODE_FLOAT64_ARRAY);
+}
+
+MwNode mw_node_item(MwNode array, unsigned index)
+{
+    MwNode result = { .snapshot = array.snapshot, .offset = 0 };
+    if (mw_node_type(array) == MW_NODE_ARRAY && index < mw_node_length(array)) {
+        uint32_t* items = get_items(array, index + 1);
+        if (items) {
+            result.offset = items[index];
+        }
+    }
+    return result;
+}
+
+MwNode mw_node_key(MwNode map, unsigned index)
+{
+    MwNode result = { .snapshot = map.snapshot, .offset = 0 };
+    if (mw_node_type(map) == MW_NODE_MAP && index < mw_node_length(map)) {
+        uint32_t* items = get_items(map, index * 2 + 2);
+        if (items) {
+            result.offset = items[index * 2];
+        }
+    }
+    return result;
+}
+
+MwNode mw_node_value(MwNode map, unsigned index)
+{
+    MwNode result = { .snapshot = map.snapshot, .offset = 0 };
+    if (mw_node_type(map) == MW_NODE_MAP && index < mw_node_length(map)) {
+        uint32_t* items = get_items(map, index * 2 + 2);
+        if (items) {
+            result.offset = items[index * 2 + 1];
+        }
+    }
+    return result;
+}
+
+bool mw_node_get(MwNode map, char* key, MwNode* value)
+{
+    if (mw_node_type(map) != MW_NODE_MAP) {
+        return false;
+    }
+    unsigned length = mw_node_length(map);
+    uint32_t* items = get_items(map, length * 3);
+    if (!items) {
+        return false;
+    }
+    uint32_t* index = items + length * 2;
+    size_t key_len = strlen(key);
+
+    // binary search in sorted indices, string keys precede others
+    unsigned lower = 0;
+    unsigned upper = length;
+    while (lower < upper) {
+        unsigned middle = lower + (upper - lower) / 2;
+        uint32_t i = index[middle];
+        if (i >= length) {
+            return false;
+        }
+        unsigned len;
+        char* k = mw_node_string((MwNode) { .snapshot = map.snapshot, .offset = items[i * 2] }, &len);
+        int result;
+        if (!k) {
+            result = 1;  // non-string key
+        } else {
+            result = memcmp(k, key, (len < key_len)? len : key_len);
+            if (result == 0) {
+                result = (len > key_len) - (len < key_len);
+            }
+        }
+        if (result == 0) {
+            value->snapshot = map.snapshot;
+            value->offset = items[i * 2 + 1];
+            return true;
+        }
+        if (result < 0) {
+            lower = middle + 1;
+        } else {
+            upper = middle;
+        }
+    }
+    return false;
+}
+
+static PwResult node_to_value(MwNode node, unsigned depth, size_t* budget)
+/*
+ * Convert node to value.
+ *
+ * Depth is limited because malformed snapshot may contain cycles.
+ * The number of converted nodes is limited by `budget` because malformed snapshot
+ * may refer to the same array or map many times and blow up exponentially.
+ */
+{
+    if (depth > SNAPSHOT_MAX_DEPTH || *budget == 0) {
+        return PwError(MW_BAD_SNAPSHOT);
+    }
+    (*budget)--;
+    switch (mw_node_type(node)) {
+        case MW_NODE_NULL:     return PwNull();
+        case MW_NODE_BOOL:     return PwBool(mw_node_bool(node));
+        case MW_NODE_SIGNED:   return PwSigned(mw_node_signed(node));
+        case MW_NODE_UNSIGNED: return PwUnsigned(mw_node_unsigned(node));
+        case MW_NODE_FLOAT:    return PwFloat(mw_node_float(node));
+
+        case MW_NODE_STRING: {
+            unsigned length;
+            char* str = mw_node_string(node, &length);
+            if (!str || str[length]) {
+                return PwError(MW_BAD_SNAPSHOT);
+            }
+            // strings may contain zero bytes
+            return _mw_create_string(str, length);
+        }
+        case MW_NODE_ARRAY: {
+            PwValue result = PwArray();
+            pw_return_if_error(&result);
+
+            unsigned length = mw_node_length(node);
+            for (unsigned i = 0; i < length; i++) {{
+                PwValue item = node_to_value(mw_node_item(node, i), depth + 1, budget);
+                pw_return_if_error(&item);
+                pw_expect_ok( pw_array_append(&result, &item) );
+            }}
+            return pw_move(&result);
+        }
+        case MW_NODE_INT64_ARRAY:
+        case MW_NODE_FLOAT64_ARRAY: {
+            bool is_int64 = mw_node_type(node) == MW_NODE_INT64_ARRAY;
+            void* items = is_int64? (void*) mw_node_int64_items(node) : (void*) mw_node_float64_items(node);
+            if (!items) {
+                return PwError(MW_BAD_SNAPSHOT);
+            }
+            unsigned length = mw_node_length(node);
+            PwValue result = mw_create_packed_array(is_int64? MW_PACKED_INT64 : MW_PACKED_FLOAT64, length);
+            pw_return_if_error(&result);
+
+            MwPackedArrayData* data = _mw_packed_array_data_ptr(&result);
+            if (length) {
+                memcpy(data->items, items, (size_t) length * sizeof(uint64_t));
+            }
+            data->length = length;
+            return pw_move(&result);
+        }
+        case MW_NODE_MAP: {
+            PwValue result = PwMap();
+            pw_return_if_error(&result);
+
+            unsigned length = mw_node_length(node);
+            for (unsigned i = 0; i < length; i++) {{
+                PwValue key = node_to_value(mw_node_key(node, i), depth + 1, budget);
+                pw_return_if_error(&key);
+                PwValue value = node_to_value(mw_node_value(node, i), depth + 1, budget);
+                pw_return_if_error(&value);
+                pw_expect_ok( pw_map_update(&result, &key, &value) );
+            }}
+            return pw_move(&result);
+        }
+    }
+    return PwError(MW_BAD_SNAPSHOT);
+}
+
+PwResult mw_node_to_value(MwNode node)
+{
+    // writer never shares arrays and maps, so each node except the root
+    // is referred to by an offset of its own, taking four bytes in the snapshot
+    size_t budget = node.snapshot->size / sizeof(uint32_t) + 1;
+    return node_to_value(node, 0, &budget);
+}
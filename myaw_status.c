@@ -4,6 +4,9 @@ PwTypeId PwTypeId_MwStatus = 0;
 
 uint16_t MW_END_OF_BLOCK = 0;
 uint16_t MW_PARSE_ERROR = 0;
+uint16_t MW_UNSUPPORTED_TYPE = 0;
+uint16_t MW_BAD_SNAPSHOT = 0;
+uint16_t MW_LIMIT_EXCEEDED = 0;
 
 PwResult _mw_parser_error(MwParser* parser, char* source_file_name, unsigned source_line_number,
                            unsigned line_number, unsigned char_pos, char* description, ...)
@@ -89,4 +92,7 @@ static void init_mw_status()
     // init status codes
     MW_END_OF_BLOCK = pw_define_status("END_OF_BLOCK");
     MW_PARSE_ERROR  = pw_define_status("PARSE_ERROR");
+    MW_UNSUPPORTED_TYPE = pw_define_status("UNSUPPORTED_TYPE");
+    MW_BAD_SNAPSHOT     = pw_define_status("BAD_SNAPSHOT");
+    MW_LIMIT_EXCEEDED   = pw_define_status("LIMIT_EXCEEDED");
 }
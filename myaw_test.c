@@ -0,0 +1,346 @@
+/*
+ * Round-trip tests.
+ *
+ * Usage: myaw_test
+ *
+ * Values are compared by their MYAW dumps, so each test checks
+ * that the tree built one way dumps the same as the tree built another way.
+ * Print failed checks and exit with non-zero status if there are any.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <myaw.h>
+
+static unsigned num_checks = 0;
+static unsigned num_failures = 0;
+
+#define check(condition)  _check((condition), #condition, __func__, __LINE__)
+
+static bool _check(bool ok, char* condition, const char* func, unsigned line_number)
+{
+    num_checks++;
+    if (!ok) {
+        num_failures++;
+        fprintf(stderr, "%s:%u: check failed: %s\n", func, line_number, condition);
+    }
+    return ok;
+}
+
+static PwResult parse(char* markup)
+{
+    PwValue text = pw_create_string(markup);
+    pw_return_if_error(&text);
+
+    PwValue reader = pw_create_string_io(&text);
+    pw_return_if_error(&reader);
+
+    return mw_parse(&reader);
+}
+
+static char* dump(PwValuePtr value)
+/*
+ * Return MYAW dump of `value` as zero-terminated string, nullptr on error.
+ * The caller must free the result.
+ */
+{
+    if (pw_error(value)) {
+        pw_print_status(stderr, value);
+        return nullptr;
+    }
+    [[ gnu::cleanup(mw_sink_fini) ]] MwSink sink;
+    PwValue status = mw_sink_init(&sink, -1, 0);
+    if (pw_ok(&status)) {
+        status = mw_dump(value, &sink, nullptr);
+    }
+    if (pw_ok(&status)) {
+        status = mw_sink_write(&sink, "", 1);
+    }
+    if (pw_error(&status)) {
+        pw_print_status(stderr, &status);
+        return nullptr;
+    }
+    return strdup(sink.data);
+}
+
+static bool same_dumps(PwValuePtr a, PwValuePtr b)
+{
+    char* dump_a = dump(a);
+    char* dump_b = dump(b);
+    bool result = dump_a && dump_b && strcmp(dump_a, dump_b) == 0;
+    if (!result && dump_a && dump_b) {
+        fprintf(stderr, "---\n%s---\n%s---\n", dump_a, dump_b);
+    }
+    free(dump_a);
+    free(dump_b);
+    return result;
+}
+
+static bool parses_same(char* markup, char* expected)
+{
+    PwValue value = parse(markup);
+    PwValue expected_value = parse(expected);
+    return same_dumps(&value, &expected_value);
+}
+
+static bool is_parse_error(char* markup)
+{
+    PwValue value = parse(markup);
+    return pw_error(&value) && value.status_code == MW_PARSE_ERROR;
+}
+
+/****************************************************************
+ * Dumper
+ */
+
+static void test_dump_round_trip()
+{
+    static char markup[] =
+        "name: test\n"
+        "count: 42\n"
+        "negative: -7\n"
+        "ratio: 2.5\n"
+        "enabled: true\n"
+        "nothing: null\n"
+        "quoted: \"tab\\there, \\\"quotes\\\" and \\u00e9t\\u00e9\"\n"
+        "number_like: \"123\"\n"
+        "text: :literal:\n"
+        "    first line\n"
+        "      indented line\n"
+        "    last line\n"
+        "list:\n"
+        "    - 1\n"
+        "    - two\n"
+        "    - key: value\n"
+        "      other: :json: [1, 2]\n"
+        "empty_list: :json: []\n"
+        "empty_map: :json: {}\n"
+        "integers: :int64[]:\n"
+        "    1, -2, 3\n"
+        "floats: :float64[]:\n"
+        "    0.5 1.5\n";
+
+    PwValue value = parse(markup);
+    if (!check(pw_ok(&value))) {
+        pw_print_status(stderr, &value);
+        return;
+    }
+    char* first = dump(&value);
+    if (!check(first != nullptr)) {
+        return;
+    }
+    // the dump parses back to the same value, so dumping it again gives the same text
+    PwValue reparsed = parse(first);
+    char* second = dump(&reparsed);
+    check(second != nullptr && strcmp(first, second) == 0);
+    free(first);
+    free(second);
+}
+
+static void test_dump_quoting()
+{
+    // strings that would be deduced as other types must survive the round trip
+    static char* strings[] = { "null", "true", "42", "-1.5", "", " leading space", "a # not a comment",
+                               ":literal:", "- item", "multi\nline", "trailing\n", "literal\nblock\n" };
+
+    for (unsigned i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {{
+        PwValue str = pw_create_string(strings[i]);
+        PwValue key = pw_create_string("key");
+        PwValue map = PwMap();
+        if (!check(pw_ok(&str) && pw_ok(&key) && pw_ok(&map))) {
+            return;
+        }
+        pw_expect_ok( pw_map_update(&map, &key, &str) );
+
+        char* text = dump(&map);
+        if (!check(text != nullptr)) {
+            return;
+        }
+        PwValue reparsed = parse(text);
+        if (!check(same_dumps(&map, &reparsed))) {
+            fprintf(stderr, "string: \"%s\"\n", strings[i]);
+        }
+        free(text);
+    }}
+}
+
+/****************************************************************
+ * Base64
+ */
+
+static void test_base64()
+{
+    check(parses_same("data: :base64: aGVsbG8gd29ybGQ=", "data: hello world"));
+    check(parses_same("data: :base64: aGVsbG8", "data: hello"));
+    check(parses_same("data: :base64:\n    aGVs bG8g\n    d29y\tbGQ=\n", "data: hello world"));
+
+    // URL-safe alphabet decodes to the same bytes
+    check(parses_same("data: :base64: -_8=", "data: :base64: +/8="));
+}
+
+static void test_base64_errors()
+{
+    check(is_parse_error("data: :base64: aGVsbG8*"));     // invalid character
+    check(is_parse_error("data: :base64: aGVsb"));        // single character in the last group
+    check(is_parse_error("data: :base64: aGVsbG8=="));    // padding beyond the group
+    check(is_parse_error("data: :base64: aG=Vs"));        // data after padding
+    check(is_parse_error("data: :base64: a==="));         // padding after one character
+    check(is_parse_error("data: :base64: aGVsé"));        // non-ASCII character
+}
+
+/****************************************************************
+ * Anchors and references
+ */
+
+static void test_anchors()
+{
+    check(parses_same(
+        "defaults:\n"
+        "    tls: :anchor tls:\n"
+        "        verify: true\n"
+        "        ca_file: /etc/ssl/ca.pem\n"
+        "services:\n"
+        "    - name: api\n"
+        "      tls: :ref: tls\n"
+        "    - name: admin\n"
+        "      tls: :ref: tls\n",
+
+        "defaults:\n"
+        "    tls:\n"
+        "        verify: true\n"
+        "        ca_file: /etc/ssl/ca.pem\n"
+        "services:\n"
+        "    - name: api\n"
+        "      tls:\n"
+        "          verify: true\n"
+        "          ca_file: /etc/ssl/ca.pem\n"
+        "    - name: admin\n"
+        "      tls:\n"
+        "          verify: true\n"
+        "          ca_file: /etc/ssl/ca.pem\n"
+    ));
+    check(parses_same(
+        "port: :anchor port: 8080\n"
+        "ports:\n"
+        "    - :ref: port\n"
+        "    - :ref: port\n",
+
+        "port: 8080\n"
+        "ports:\n"
+        "    - 8080\n"
+        "    - 8080\n"
+    ));
+}
+
+static void test_anchor_errors()
+{
+    check(is_parse_error("value: :ref: missing\n"));
+    check(is_parse_error("value: :ref: later\nlater: :anchor later: 1\n"));
+    check(is_parse_error("value: :anchor: 1\n"));
+}
+
+/****************************************************************
+ * Incremental reparse
+ */
+
+static bool reparses_same(char* old_markup, char* new_markup)
+/*
+ * Parse `old_markup`, reparse it as `new_markup`,
+ * and compare the result with full parse of `new_markup`.
+ */
+{
+    PwValue old_text = pw_create_string(old_markup);
+    PwValue new_text = pw_create_string(new_markup);
+    if (!check(pw_ok(&old_text) && pw_ok(&new_text))) {
+        return false;
+    }
+    PwValue old_tree = parse(old_markup);
+    if (!check(pw_ok(&old_tree))) {
+        return false;
+    }
+    PwValue reparsed = mw_reparse(&old_tree, &old_text, &new_text);
+    PwValue expected = parse(new_markup);
+    return same_dumps(&reparsed, &expected);
+}
+
+static void test_reparse()
+{
+    static char base[] =
+        "name: service\n"
+        "port: 8080\n"
+        "hosts:\n"
+        "    - alpha\n"
+        "    - beta\n"
+        "# comment\n"
+        "limits:\n"
+        "    cpu: 2\n"
+        "    memory: 512\n";
+
+    check(reparses_same(base, base));
+
+    // changed value
+    check(reparses_same(base,
+        "name: service\n"
+        "port: 9090\n"
+        "hosts:\n"
+        "    - alpha\n"
+        "    - beta\n"
+        "# comment\n"
+        "limits:\n"
+        "    cpu: 2\n"
+        "    memory: 512\n"
+    ));
+    // changed nested block, added and removed keys
+    check(reparses_same(base,
+        "name: service\n"
+        "hosts:\n"
+        "    - alpha\n"
+        "    - gamma\n"
+        "limits:\n"
+        "    cpu: 4\n"
+        "    memory: 512\n"
+        "timeout: 30\n"
+    ));
+    // anchors and references force full parse
+    check(reparses_same(
+        "base: :anchor base: 1\n"
+        "value: :ref: base\n",
+
+        "base: :anchor base: 2\n"
+        "value: :ref: base\n"
+    ));
+    // not a map any longer
+    check(reparses_same(base, "- one\n- two\n"));
+}
+
+static void test_reparse_errors()
+{
+    static char old_markup[] = "a: 1\nb: 2\n";
+    static char new_markup[] = "a: 1\nb: \"unterminated\n";
+
+    PwValue old_text = pw_create_string(old_markup);
+    PwValue new_text = pw_create_string(new_markup);
+    PwValue old_tree = parse(old_markup);
+    if (!check(pw_ok(&old_text) && pw_ok(&new_text) && pw_ok(&old_tree))) {
+        return;
+    }
+    PwValue result = mw_reparse(&old_tree, &old_text, &new_text);
+    check(pw_error(&result) && result.status_code == MW_PARSE_ERROR);
+}
+
+int main(int argc, char* argv[])
+{
+    test_dump_round_trip();
+    test_dump_quoting();
+    test_base64();
+    test_base64_errors();
+    test_anchors();
+    test_anchor_errors();
+    test_reparse();
+    test_reparse_errors();
+
+    printf("%u checks, %u failed\n", num_checks, num_failures);
+    return num_failures? 1 : 0;
+}
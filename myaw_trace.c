@@ -0,0 +1,255 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <myaw.h>
+
+/*
+ * Runtime tracer.
+ *
+ * Each thread records completed spans to its own ring buffer,
+ * so recording takes neither locks nor read-modify-write atomics.
+ * Buffers are registered in a global list on first use and kept after
+ * thread exit until mw_trace_clear, so events of worker threads
+ * can be exported after they are joined.
+ *
+ * Exporter may run while the owner overwrites old events, so each slot
+ * is protected by a sequence number: odd while the event is written,
+ * and 2 * (event index + 1) when it is complete. Exporter copies the event
+ * and skips it if the sequence number was not the expected one or changed.
+ */
+
+typedef struct {
+    char*    name;
+    unsigned line_number;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    char     detail[24];
+} TraceEvent;
+
+typedef struct {
+    _Atomic uint64_t seq;
+    TraceEvent       event;
+} TraceSlot;
+
+typedef struct TraceBuffer TraceBuffer;
+
+struct TraceBuffer {
+    TraceBuffer*     next;
+    unsigned         tid;
+    atomic_bool      alive;  // owner thread is running
+    _Atomic uint64_t head;   // total number of recorded events, written by owner only
+    uint64_t         start;  // index of the first event after mw_trace_clear, protected by buffers_mutex
+    TraceSlot        slots[MW_TRACE_BUFFER_SIZE];
+};
+
+bool _mw_trace_enabled = false;
+
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TraceBuffer* buffers = nullptr;
+static unsigned next_tid = 1;
+
+static pthread_key_t buffer_key;
+static _Thread_local TraceBuffer* thread_buffer = nullptr;
+
+static uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void thread_exit(void* buffer)
+{
+    atomic_store(&((TraceBuffer*) buffer)->alive, false);
+}
+
+static TraceBuffer* register_thread()
+{
+    TraceBuffer* buffer = malloc(sizeof(TraceBuffer));
+    if (!buffer) {
+        return nullptr;
+    }
+    atomic_init(&buffer->alive, true);
+    atomic_init(&buffer->head, 0);
+    buffer->start = 0;
+    for (unsigned i = 0; i < MW_TRACE_BUFFER_SIZE; i++) {
+        atomic_init(&buffer->slots[i].seq, 0);
+    }
+
+    pthread_mutex_lock(&buffers_mutex);
+    buffer->tid = next_tid++;
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&buffers_mutex);
+
+    pthread_setspecific(buffer_key, buffer);
+    thread_buffer = buffer;
+    return buffer;
+}
+
+void mw_trace_enable(bool enable)
+{
+    __atomic_store_n(&_mw_trace_enabled, enable, __ATOMIC_RELAXED);
+}
+
+MwTraceSpan _mw_trace_span_begin(char* name, unsigned line_number)
+{
+    return (MwTraceSpan) {
+        .name = name,
+        .line_number = line_number,
+        .start_ns = monotonic_ns()
+    };
+}
+
+void _mw_trace_span_end(MwTraceSpan* span)
+{
+    if (!span->name) {
+        return;
+    }
+    TraceBuffer* buffer = thread_buffer;
+    if (!buffer) {
+        buffer = register_thread();
+        if (!buffer) {
+            return;
+        }
+    }
+    uint64_t end_ns = monotonic_ns();
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+    TraceSlot* slot = &buffer->slots[head & (MW_TRACE_BUFFER_SIZE - 1)];
+
+    // mark slot as being written, exporter skips it until the event is complete
+    atomic_store_explicit(&slot->seq, head * 2 + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    TraceEvent* event = &slot->event;
+    event->name = span->name;
+    event->line_number = span->line_number;
+    event->start_ns = span->start_ns;
+    event->duration_ns = end_ns - span->start_ns;
+    memcpy(event->detail, span->detail, sizeof(event->detail));
+
+    // publish event for exporter
+    atomic_store_explicit(&slot->seq, head * 2 + 2, memory_order_release);
+    atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+void _mw_trace_span_detail(MwTraceSpan* span, PwValuePtr str)
+{
+    if (!span->name || !pw_is_string(str)) {
+        return;
+    }
+    // keep printable ASCII only, so the detail needs no escaping in JSON
+    unsigned length = pw_strlen(str);
+    unsigned n = 0;
+    for (unsigned i = 0; i < length && n < sizeof(span->detail) - 1; i++) {
+        char32_t chr = pw_char_at(str, i);
+        if (chr < ' ' || chr > '~' || chr == '"' || chr == '\\') {
+            chr = '?';
+        }
+        span->detail[n++] = (char) chr;
+    }
+    span->detail[n] = 0;
+}
+
+static PwResult write_event(MwSink* sink, TraceEvent* event, unsigned tid, bool first)
+{
+    char buffer[256];
+    int n = snprintf(buffer, sizeof(buffer),
+        "%s{\"name\":\"%s\",\"cat\":\"myaw\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+        "\"pid\":%d,\"tid\":%u,\"args\":{\"line\":%u%s%s%s}}",
+        first? "\n" : ",\n",
+        event->name,
+        (double) event->start_ns / 1000.0,
+        (double) event->duration_ns / 1000.0,
+        (int) getpid(), tid,
+        event->line_number,
+        event->detail[0]? ",\"convspec\":\"" : "", event->detail, event->detail[0]? "\"" : ""
+    );
+    if (n < 0) {
+        return PwErrno(errno);
+    }
+    if ((size_t) n >= sizeof(buffer)) {
+        // snprintf returns the length the output would have, not what was written
+        n = sizeof(buffer) - 1;
+    }
+    return mw_sink_write(sink, buffer, n);
+}
+
+static PwResult export_buffers(MwSink* sink)
+{
+    bool first = true;
+    for (TraceBuffer* buffer = buffers; buffer; buffer = buffer->next) {{
+        uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+        uint64_t tail = (head > MW_TRACE_BUFFER_SIZE)? head - MW_TRACE_BUFFER_SIZE : 0;
+        if (tail < buffer->start) {
+            tail = buffer->start;
+        }
+        for (uint64_t i = tail; i < head; i++) {{
+            TraceSlot* slot = &buffer->slots[i & (MW_TRACE_BUFFER_SIZE - 1)];
+            uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+            if (seq != i * 2 + 2) {
+                // overwritten by the owner
+                continue;
+            }
+            TraceEvent event = slot->event;
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+                // overwritten while being copied
+                continue;
+            }
+            PwValue status = write_event(sink, &event, buffer->tid, first);
+            pw_return_if_error(&status);
+            first = false;
+        }}
+    }}
+    return PwOK();
+}
+
+PwResult mw_trace_export(MwSink* sink)
+{
+    static char header[] = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    static char footer[] = "\n]}\n";
+
+    PwValue status = mw_sink_write(sink, header, sizeof(header) - 1);
+    pw_return_if_error(&status);
+
+    pthread_mutex_lock(&buffers_mutex);
+    status = export_buffers(sink);
+    pthread_mutex_unlock(&buffers_mutex);
+    pw_return_if_error(&status);
+
+    status = mw_sink_write(sink, footer, sizeof(footer) - 1);
+    pw_return_if_error(&status);
+
+    return mw_sink_flush(sink);
+}
+
+void mw_trace_clear()
+{
+    pthread_mutex_lock(&buffers_mutex);
+    TraceBuffer** prev = &buffers;
+    while (*prev) {
+        TraceBuffer* buffer = *prev;
+        if (atomic_load(&buffer->alive)) {
+            // head belongs to the owner thread, only move the start of exported events
+            buffer->start = atomic_load_explicit(&buffer->head, memory_order_acquire);
+            prev = &buffer->next;
+        } else {
+            *prev = buffer->next;
+            free(buffer);
+        }
+    }
+    pthread_mutex_unlock(&buffers_mutex);
+}
+
+[[ gnu::constructor ]]
+static void init_mw_trace()
+{
+    pthread_key_create(&buffer_key, thread_exit);
+}
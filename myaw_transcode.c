@@ -0,0 +1,236 @@
+#include <stdlib.h>
+
+#include <myaw.h>
+
+/*
+ * MYAW to JSON transcoder.
+ *
+ * JSON is written by event handler while the parser walks the markup.
+ * The only state is a stack of flags, one per nesting level,
+ * telling if a separator is needed before the next item.
+ */
+
+typedef struct {
+    MwEventHandler base;
+    MwSink*  sink;
+    bool*    first_item;  // per nesting level
+    unsigned depth;
+    unsigned capacity;
+    bool     after_key;   // next value follows key and needs no separator
+} JsonWriter;
+
+static PwResult write_json_value(MwSink* sink, PwValuePtr value);
+
+static PwResult write_json_key(MwSink* sink, PwValuePtr key)
+/*
+ * JSON keys are strings, convert other scalar keys.
+ */
+{
+    if (pw_is_string(key)) {
+        return _mw_sink_write_quoted(sink, key);
+    }
+    if (pw_is_array(key) || pw_is_map(key) || mw_is_packed_array(key)) {
+        return PwError(MW_UNSUPPORTED_TYPE);
+    }
+    PwValue status = mw_sink_write(sink, "\"", 1);
+    pw_return_if_error(&status);
+
+    status = write_json_value(sink, key);
+    pw_return_if_error(&status);
+
+    return mw_sink_write(sink, "\"", 1);
+}
+
+static PwResult write_json_value(MwSink* sink, PwValuePtr value)
+{
+    if (pw_is_null(value)) {
+        return mw_sink_write(sink, "null", 4);
+    }
+    if (pw_is_bool(value)) {
+        if (value->bool_value) {
+            return mw_sink_write(sink, "true", 4);
+        } else {
+            return mw_sink_write(sink, "false", 5);
+        }
+    }
+    if (pw_is_string(value)) {
+        return _mw_sink_write_quoted(sink, value);
+    }
+    if (mw_is_packed_array(value)) {
+        PwValue status = mw_sink_write(sink, "[", 1);
+        pw_return_if_error(&status);
+
+        unsigned length = mw_packed_length(value);
+        for (unsigned i = 0; i < length; i++) {{
+            if (i) {
+                status = mw_sink_write(sink, ",", 1);
+                pw_return_if_error(&status);
+            }
+            PwValue item = mw_packed_item(value, i);
+            status = _mw_sink_write_number(sink, &item);
+            pw_return_if_error(&status);
+        }}
+        return mw_sink_write(sink, "]", 1);
+    }
+    if (pw_is_array(value)) {
+        PwValue status = mw_sink_write(sink, "[", 1);
+        pw_return_if_error(&status);
+
+        unsigned length = pw_array_length(value);
+        for (unsigned i = 0; i < length; i++) {{
+            if (i) {
+                status = mw_sink_write(sink, ",", 1);
+                pw_return_if_error(&status);
+            }
+            PwValue item = pw_array_item(value, i);
+            status = write_json_value(sink, &item);
+            pw_return_if_error(&status);
+        }}
+        return mw_sink_write(sink, "]", 1);
+    }
+    if (pw_is_map(value)) {
+        PwValue status = mw_sink_write(sink, "{", 1);
+        pw_return_if_error(&status);
+
+        unsigned length = pw_map_length(value);
+        for (unsigned i = 0; i < length; i++) {{
+            if (i) {
+                status = mw_sink_write(sink, ",", 1);
+                pw_return_if_error(&status);
+            }
+            PwValue key = PwNull();
+            PwValue item = PwNull();
+            pw_map_item(value, i, &key, &item);
+
+            status = write_json_key(sink, &key);
+            pw_return_if_error(&status);
+
+            status = mw_sink_write(sink, ":", 1);
+            pw_return_if_error(&status);
+
+            status = write_json_value(sink, &item);
+            pw_return_if_error(&status);
+        }}
+        return mw_sink_write(sink, "}", 1);
+    }
+    return _mw_sink_write_number(sink, value);
+}
+
+static PwResult write_separator(JsonWriter* writer)
+{
+    if (writer->after_key) {
+        writer->after_key = false;
+        return PwOK();
+    }
+    if (writer->depth == 0) {
+        return PwOK();
+    }
+    if (writer->first_item[writer->depth - 1]) {
+        writer->first_item[writer->depth - 1] = false;
+        return PwOK();
+    }
+    return mw_sink_write(writer->sink, ",", 1);
+}
+
+static PwResult start_container(JsonWriter* writer, char* bracket)
+{
+    PwValue status = write_separator(writer);
+    pw_return_if_error(&status);
+
+    if (writer->depth == writer->capacity) {
+        unsigned capacity = writer->capacity? writer->capacity * 2 : MW_MAX_RECURSION_DEPTH;
+        bool* first_item = realloc(writer->first_item, capacity * sizeof(bool));
+        if (!first_item) {
+            return PwOOM();
+        }
+        writer->first_item = first_item;
+        writer->capacity = capacity;
+    }
+    writer->first_item[writer->depth++] = true;
+    return mw_sink_write(writer->sink, bracket, 1);
+}
+
+static PwResult end_container(JsonWriter* writer, char* bracket)
+{
+    writer->depth--;
+    return mw_sink_write(writer->sink, bracket, 1);
+}
+
+static PwResult json_start_list(MwEventHandler* handler)
+{
+    return start_container((JsonWriter*) handler, "[");
+}
+
+static PwResult json_end_list(MwEventHandler* handler)
+{
+    return end_container((JsonWriter*) handler, "]");
+}
+
+static PwResult json_start_map(MwEventHandler* handler)
+{
+    return start_container((JsonWriter*) handler, "{");
+}
+
+static PwResult json_end_map(MwEventHandler* handler)
+{
+    return end_container((JsonWriter*) handler, "}");
+}
+
+static PwResult json_key(MwEventHandler* handler, PwValuePtr key)
+{
+    JsonWriter* writer = (JsonWriter*) handler;
+
+    PwValue status = write_separator(writer);
+    pw_return_if_error(&status);
+
+    status = write_json_key(writer->sink, key);
+    pw_return_if_error(&status);
+
+    writer->after_key = true;
+    return mw_sink_write(writer->sink, ":", 1);
+}
+
+static PwResult json_value(MwEventHandler* handler, PwValuePtr value)
+{
+    JsonWriter* writer = (JsonWriter*) handler;
+
+    PwValue status = write_separator(writer);
+    pw_return_if_error(&status);
+
+    return write_json_value(writer->sink, value);
+}
+
+static PwResult transcode(MwParser* parser, MwSink* sink)
+{
+    PwValue result = mw_parser_parse(parser);
+    pw_return_if_error(&result);
+
+    PwValue status = mw_sink_write(sink, "\n", 1);
+    pw_return_if_error(&status);
+
+    return mw_sink_flush(sink);
+}
+
+PwResult mw_transcode_json(PwValuePtr markup, MwSink* sink)
+{
+    [[ gnu::cleanup(mw_delete_parser) ]] MwParser* parser = mw_create_parser(markup);
+    if (!parser) {
+        return PwOOM();
+    }
+    JsonWriter writer = {
+        .base = {
+            .start_list = json_start_list,
+            .end_list   = json_end_list,
+            .start_map  = json_start_map,
+            .end_map    = json_end_map,
+            .key        = json_key,
+            .value      = json_value
+        },
+        .sink = sink
+    };
+    parser->event_handler = &writer.base;
+
+    PwValue status = transcode(parser, sink);
+    free(writer.first_item);
+    return pw_move(&status);
+}
@@ -0,0 +1,370 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <myaw.h>
+
+/*
+ * Hot-reload watcher.
+ *
+ * Parsed trees are published through an atomic pointer and reclaimed
+ * with epoch-based scheme:
+ *
+ * - readers store current global epoch in their slot before loading
+ *   the pointer and clear the slot when done;
+ * - the writer swaps the pointer, increments global epoch,
+ *   and retires the old version with the new epoch;
+ * - retired versions are freed when all active readers
+ *   have entered at or after their retire epoch.
+ *
+ * The directory of the file is watched. Besides events for the file itself,
+ * any entry created or moved into the directory makes the watcher re-stat
+ * the path, because the file may be reached through a symbolic link
+ * that was swapped, e.g. `..data` of Kubernetes ConfigMap volumes.
+ */
+
+#define RECLAIM_INTERVAL_MS  1000
+
+typedef struct _Version Version;
+
+struct _Version {
+    _PwValue tree;
+    uint64_t retire_epoch;
+    Version* next;
+};
+
+typedef struct {
+    atomic_bool     in_use;
+    _Atomic uint64_t epoch;  // zero if reader is not active
+} ReaderSlot;
+
+struct _MwWatcher {
+    char path[PATH_MAX];
+    char directory[PATH_MAX];
+    char* file_name;  // points to path
+
+    MwValidateFunc    validate;
+    MwReloadErrorFunc on_error;
+    void* arg;
+
+    struct stat loaded_stat;  // of the file the current version was loaded from, following links
+
+    _Atomic(Version*) current;
+    _Atomic uint64_t  epoch;
+    _Atomic uint64_t  generation;
+    Version*          retired;  // accessed by the watch thread and mw_watcher_stop only
+
+    ReaderSlot readers[MW_WATCHER_MAX_READERS];
+
+    int inotify_fd;
+    int stop_fd;
+    pthread_t thread;
+    bool thread_started;
+};
+
+static void free_version(Version* version)
+{
+    pw_destroy(&version->tree);
+    release((void**) &version, sizeof(Version));
+}
+
+static PwResult load_version(MwWatcher* watcher, Version** result)
+{
+    // stat before opening: if the file is replaced meanwhile, there will be another event
+    if (stat(watcher->path, &watcher->loaded_stat) == -1) {
+        return PwErrno(errno);
+    }
+    PWDECL_CharPtr(file_name, watcher->path);
+    PwValue file = pw_file_open(&file_name, O_RDONLY, 0);
+    pw_return_if_error(&file);
+
+    PwValue tree = mw_parse(&file);
+    pw_return_if_error(&tree);
+
+    if (watcher->validate) {
+        PwValue status = watcher->validate(&tree, watcher->arg);
+        pw_return_if_error(&status);
+    }
+
+    Version* version = allocate(sizeof(Version), true);
+    if (!version) {
+        return PwOOM();
+    }
+    version->tree = pw_move(&tree);
+    *result = version;
+    return PwOK();
+}
+
+static uint64_t min_reader_epoch(MwWatcher* watcher)
+{
+    uint64_t min_epoch = UINT64_MAX;
+    for (unsigned i = 0; i < MW_WATCHER_MAX_READERS; i++) {
+        uint64_t epoch = atomic_load(&watcher->readers[i].epoch);
+        if (epoch && epoch < min_epoch) {
+            min_epoch = epoch;
+        }
+    }
+    return min_epoch;
+}
+
+static void reclaim(MwWatcher* watcher)
+{
+    uint64_t min_epoch = min_reader_epoch(watcher);
+
+    Version** prev = &watcher->retired;
+    while (*prev) {
+        Version* version = *prev;
+        if (version->retire_epoch <= min_epoch) {
+            *prev = version->next;
+            free_version(version);
+        } else {
+            prev = &version->next;
+        }
+    }
+}
+
+static void publish(MwWatcher* watcher, Version* version)
+{
+    Version* old = atomic_exchange(&watcher->current, version);
+    atomic_fetch_add(&watcher->generation, 1);
+    uint64_t epoch = atomic_fetch_add(&watcher->epoch, 1) + 1;
+    if (old) {
+        old->retire_epoch = epoch;
+        old->next = watcher->retired;
+        watcher->retired = old;
+    }
+    reclaim(watcher);
+}
+
+static bool path_changed(MwWatcher* watcher)
+/*
+ * Check if the path resolves to other file than the current version was loaded from.
+ */
+{
+    struct stat st;
+    if (stat(watcher->path, &st) == -1) {
+        // removed or dangling link, keep current version
+        return false;
+    }
+    struct stat* loaded = &watcher->loaded_stat;
+    return st.st_dev != loaded->st_dev
+        || st.st_ino != loaded->st_ino
+        || st.st_size != loaded->st_size
+        || st.st_mtim.tv_sec != loaded->st_mtim.tv_sec
+        || st.st_mtim.tv_nsec != loaded->st_mtim.tv_nsec;
+}
+
+static bool file_changed(MwWatcher* watcher)
+/*
+ * Read inotify events and return true if any of them is for the watched file.
+ * If the event queue overflowed, events for the file could be lost,
+ * so the file is considered changed.
+ * Other entries created or moved into the directory may be links
+ * the path goes through, so the path is checked for them.
+ */
+{
+    alignas(struct inotify_event) char buffer[4096];
+    bool changed = false;
+    bool check_path = false;
+    for (;;) {
+        ssize_t n = read(watcher->inotify_fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        for (char* p = buffer; p < buffer + n;) {
+            struct inotify_event* event = (struct inotify_event*) p;
+            if (event->mask & IN_Q_OVERFLOW) {
+                changed = true;
+            } else if (event->len && strcmp(event->name, watcher->file_name) == 0) {
+                // newly created file is not written yet, wait for IN_CLOSE_WRITE,
+                // but it can be a link
+                if (event->mask & IN_CREATE) {
+                    check_path = true;
+                } else {
+                    changed = true;
+                }
+            } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                check_path = true;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed || (check_path && path_changed(watcher));
+}
+
+static void* watch_thread(void* arg)
+{
+    MwWatcher* watcher = arg;
+    for (;;) {
+        struct pollfd fds[2] = {
+            { .fd = watcher->inotify_fd, .events = POLLIN },
+            { .fd = watcher->stop_fd,    .events = POLLIN }
+        };
+        int timeout = watcher->retired? RECLAIM_INTERVAL_MS : -1;
+        int n = poll(fds, 2, timeout);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (fds[0].revents && file_changed(watcher)) {
+            Version* version;
+            PwValue status = load_version(watcher, &version);
+            if (pw_ok(&status)) {
+                publish(watcher, version);
+            } else if (watcher->on_error) {
+                // keep serving current version
+                watcher->on_error(&status, watcher->arg);
+            }
+        }
+        reclaim(watcher);
+    }
+    return nullptr;
+}
+
+PwResult mw_watcher_start(char* path, MwValidateFunc validate, MwReloadErrorFunc on_error, void* arg,
+                          MwWatcher** result)
+{
+    if (strlen(path) >= PATH_MAX) {
+        return PwErrno(ENAMETOOLONG);
+    }
+    MwWatcher* watcher = allocate(sizeof(MwWatcher), true);
+    if (!watcher) {
+        return PwOOM();
+    }
+    watcher->inotify_fd = -1;
+    watcher->stop_fd = -1;
+    watcher->validate = validate;
+    watcher->on_error = on_error;
+    watcher->arg = arg;
+    atomic_init(&watcher->epoch, 1);
+    atomic_init(&watcher->generation, 1);
+
+    strcpy(watcher->path, path);
+    strcpy(watcher->directory, path);
+    char* slash = strrchr(watcher->directory, '/');
+    if (slash) {
+        *slash = 0;
+        watcher->file_name = watcher->path + (slash - watcher->directory) + 1;
+    } else {
+        strcpy(watcher->directory, ".");
+        watcher->file_name = watcher->path;
+    }
+
+    PwValue status = PwOK();
+
+    // load initial version
+    Version* version;
+    status = load_version(watcher, &version);
+    if (pw_error(&status)) {
+        goto error;
+    }
+    atomic_init(&watcher->current, version);
+
+    // watch the directory rather than the file, editors and deployment tools
+    // usually replace files by renaming or swapping links
+    watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->inotify_fd == -1
+        || inotify_add_watch(watcher->inotify_fd, watcher->directory,
+                             IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) == -1) {
+        status = PwErrno(errno);
+        goto error;
+    }
+    watcher->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (watcher->stop_fd == -1) {
+        status = PwErrno(errno);
+        goto error;
+    }
+    int err = pthread_create(&watcher->thread, nullptr, watch_thread, watcher);
+    if (err) {
+        status = PwErrno(err);
+        goto error;
+    }
+    watcher->thread_started = true;
+
+    *result = watcher;
+    return PwOK();
+
+error:
+    mw_watcher_stop(&watcher);
+    return pw_move(&status);
+}
+
+void mw_watcher_stop(MwWatcher** watcher_ptr)
+{
+    MwWatcher* watcher = *watcher_ptr;
+    *watcher_ptr = nullptr;
+    if (!watcher) {
+        return;
+    }
+    if (watcher->thread_started) {
+        uint64_t one = 1;
+        while (write(watcher->stop_fd, &one, sizeof(one)) == -1 && errno == EINTR) {}
+        pthread_join(watcher->thread, nullptr);
+    }
+    if (watcher->inotify_fd != -1) {
+        close(watcher->inotify_fd);
+    }
+    if (watcher->stop_fd != -1) {
+        close(watcher->stop_fd);
+    }
+    Version* version = atomic_load(&watcher->current);
+    if (version) {
+        free_version(version);
+    }
+    while (watcher->retired) {
+        version = watcher->retired;
+        watcher->retired = version->next;
+        free_version(version);
+    }
+    release((void**) &watcher, sizeof(MwWatcher));
+}
+
+int mw_watcher_register_reader(MwWatcher* watcher)
+{
+    for (unsigned i = 0; i < MW_WATCHER_MAX_READERS; i++) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&watcher->readers[i].in_use, &expected, true)) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+void mw_watcher_unregister_reader(MwWatcher* watcher, int reader)
+{
+    atomic_store(&watcher->readers[reader].epoch, 0);
+    atomic_store(&watcher->readers[reader].in_use, false);
+}
+
+PwValuePtr mw_watcher_enter(MwWatcher* watcher, int reader)
+{
+    // sequentially consistent store and load: the writer must see this slot
+    // before it frees the version we are going to load
+    atomic_store(&watcher->readers[reader].epoch, atomic_load(&watcher->epoch));
+    Version* version = atomic_load(&watcher->current);
+    return &version->tree;
+}
+
+void mw_watcher_leave(MwWatcher* watcher, int reader)
+{
+    atomic_store_explicit(&watcher->readers[reader].epoch, 0, memory_order_release);
+}
+
+uint64_t mw_watcher_generation(MwWatcher* watcher)
+{
+    return atomic_load(&watcher->generation);
+}